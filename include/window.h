@@ -1,6 +1,13 @@
 #ifndef HT_WINDOW_H
 #define HT_WINDOW_H
 
+/* The makefile builds a static archive, so programs link the libraries the
+ * backend uses themselves:
+ *   X11:   -lX11 -lXext -lXi -lXrandr -lXpresent -lXfixes -lpthread and
+ *          -lGL, plus -lEGL when built with EGL=1
+ *   Cocoa: -framework Cocoa -framework IOKit -framework OpenGL
+ *   Win32: gdi32.lib opengl32.lib user32.lib (build.bat builds a DLL) */
+
 /*-------------------------------------------------------------------- MACROS */
 
 /* Default OpenGL pixel format values */
@@ -34,6 +41,15 @@
 #define HT_MAX_GL_STENCIL_BUFFER         8
 #define HT_MAX_GL_ACCUM_BUFFER         128
 
+/* Maximum frames queued on a present thread */
+#define HT_MAX_GL_FRAMES_IN_FLIGHT       4
+
+/* Maximum software framebuffers of a window */
+#define HT_MAX_FRAMEBUFFERS              3
+
+/* Maximum monitors tracked per instance */
+#define HT_MAX_MONITORS                 16
+
 /* Raw input value masks */
 #define HT_INPUT_MASK_X          0xFFFF
 #define HT_INPUT_MASK_Y          0xFFFF
@@ -41,6 +57,7 @@
 
 /* Helper macro functions */
 #define HT_MIN(x, y) ((y) ^ (((x) ^ (y)) & -((x) < (y))))
+#define HT_MAX(x, y) ((x) ^ (((x) ^ (y)) & -((x) < (y))))
 
 /*--------------------------------------------------------------------- ENUMS */
 
@@ -61,7 +78,8 @@ typedef enum {
   HT_ERROR_POOL_EMPTY,
   HT_ERROR_STACK_EMPTY,
   HT_ERROR_STACK_OVERFLOW,
-  HT_ERROR_WINDOW_SERVER
+  HT_ERROR_WINDOW_SERVER,
+  HT_ERROR_UNSUPPORTED
 } HTResult;
 
 typedef enum {
@@ -75,6 +93,7 @@ typedef enum {
   HT_EVENT_KEYBOARD, /* Keyboard was pressed/released     */
   HT_EVENT_MOUSE,    /* Mouse was moved/clicked           */
   HT_EVENT_GAMEPAD,  /* Gamepad was pressed/release/moved */
+  HT_EVENT_PRESENT,  /* Presented frame reached the screen */
   HT_EVENT_COUNT     /* Number of window events           */
 } HTEvent;
 
@@ -102,6 +121,7 @@ typedef enum {
   HT_GL_COLOR_BUFFER,       /* [R-] Number of color (RGBA) buffer bits  */
   HT_GL_DEPTH_BUFFER,       /* [RW] Number of depth buffer bits         */
   HT_GL_DOUBLE_BUFFERING,   /* [RW] Pixel format is double buffered     */
+  HT_GL_FOOTPRINT,          /* [R-] Estimated framebuffer memory in KiB */
   HT_GL_GREEN,              /* [RW] Number of green channel bits        */
   HT_GL_MAJOR_VERSION,      /* [RW] Context major version               */
   HT_GL_MINOR_VERSION,      /* [RW] Context minor version               */
@@ -116,12 +136,22 @@ typedef enum {
   HT_INPUT_KEYBOARD_CODE,   /* [R-] Last key pressed/released           */
   HT_INPUT_KEYBOARD_STATE,  /* [R-] State of the last key press/release */
   HT_INPUT_MOUSE_BUTTON,    /* [R-] Raw input for mouse button states   */
+  HT_INPUT_MOUSE_GRAB,      /* [RW] Pointer is captured while focused   */
   HT_INPUT_MOUSE_RELATIVE,  /* [R-] Mouse uses relative positions       */
   HT_INPUT_MOUSE_X,         /* [R-] X position of mouse                 */
   HT_INPUT_MOUSE_Y,         /* [R-] Y position of mouse                 */
+  HT_WINDOW_FRAMEBUFFER,    /* [R-] Pixels of the software framebuffer  */
+  HT_WINDOW_FRAMEBUFFERS,   /* [RW] Number of software framebuffers     */
+  HT_WINDOW_FULLSCREEN,     /* [RW] Window covers its whole monitor     */
   HT_WINDOW_HEIGHT,         /* [RW] Height of the content area          */
+  HT_WINDOW_MONITOR,        /* [R-] Monitor covering most of the window */
+  HT_WINDOW_PITCH,          /* [R-] Bytes per row of the framebuffer    */
+  HT_WINDOW_PIXEL_FORMAT,   /* [RW] Pixel layout of the framebuffer     */
+  HT_WINDOW_PRESENT_INFO,   /* [R-] Timing of the last present shown    */
+  HT_WINDOW_REFRESH_RATE,   /* [R-] Refresh of the monitor in mHz       */
   HT_WINDOW_STYLE,          /* [RW] Window style property values        */
   HT_WINDOW_TITLE,          /* [-W] Window title                        */
+  HT_WINDOW_UNREDIRECTED,   /* [R-] Frames bypass the compositor copy   */
   HT_WINDOW_WIDTH,          /* [RW] Width of the content area           */
   HT_WINDOW_USER,           /* [RW] User-defined data to pass to window */
   HT_WINDOW_X,              /* [RW] X position of the top-left corner   */
@@ -137,9 +167,55 @@ typedef enum {
   HT_WINDOW_STYLE_DEFAULT  = 0x0F  /* Window has all of the above  */
 } HTWindowStyle;
 
+typedef enum {
+  HT_PIXEL_FORMAT_NATIVE, /* Layout of the window server visual       */
+  HT_PIXEL_FORMAT_BGRA8,  /* 32-bit pixels, blue byte first           */
+  HT_PIXEL_FORMAT_RGBA8,  /* 32-bit pixels, red byte first            */
+  HT_PIXEL_FORMAT_RGB565  /* 16-bit pixels, red in the high 5 bits    */
+} HTPixelFormat;
+
+typedef enum {
+  HT_FLUSH_ALWAYS,  /* Flush on create, destroy and present       */
+  HT_FLUSH_ON_SWAP, /* Flush on present and event polling only    */
+  HT_FLUSH_ON_POLL  /* Flush only when events are polled          */
+} HTFlushPolicy;
+
 /*------------------------------------------------------------------- STRUCTS */
 
-typedef struct HTWindow HTWindow; /* Opaque pointer to window */
+typedef struct HTInstance HTInstance; /* Opaque pointer to instance */
+typedef struct HTWindow   HTWindow;   /* Opaque pointer to window   */
+
+typedef struct HTWindowDesc {
+  int         x;        /* X position of the top-left corner   */
+  int         y;        /* Y position of the top-left corner   */
+  unsigned    width;    /* Width of the content area           */
+  unsigned    height;   /* Height of the content area          */
+  const char* title;    /* Window title, or NULL for none      */
+  HTInstance* instance; /* Owning instance, or NULL for default */
+} HTWindowDesc;
+
+typedef struct HTRect {
+  int      x;      /* X position of the top-left corner */
+  int      y;      /* Y position of the top-left corner */
+  unsigned width;  /* Width of the rectangle            */
+  unsigned height; /* Height of the rectangle           */
+} HTRect;
+
+typedef struct HTMonitor {
+  int      x;       /* X position of the top-left corner */
+  int      y;       /* Y position of the top-left corner */
+  unsigned width;   /* Width of the monitor              */
+  unsigned height;  /* Height of the monitor             */
+  unsigned refresh; /* Refresh rate in mHz, 0 if unknown */
+  int      primary; /* Monitor is the primary one        */
+} HTMonitor;
+
+typedef struct HTPresentInfo {
+  unsigned long serial; /* Number of the completed present          */
+  unsigned long ust;    /* Completion time in microseconds          */
+  unsigned long msc;    /* Media stream counter at completion       */
+  int           flip;   /* Frame was flipped to rather than copied  */
+} HTPresentInfo;
 
 typedef struct htErrorInfo {
   char*    file;     /* File where the error occurred        */
@@ -159,22 +235,85 @@ typedef void (*HTWindowErrorCallback)(htErrorInfo* info);
 extern "C" {
 #endif
 
-int htCreateWindow(HTWindow**, short, short, unsigned short, unsigned short);
+/* X11: windows may be created, used and destroyed on different threads at
+ * once. Calls on one window, and the input manager, must be serialized by the
+ * caller. Shared GL contexts may be acquired and released from any thread.
+ *
+ * With a present thread every queued frame keeps its own framebuffer object
+ * until the thread has shown it, so frames never overwrite each other. Up to
+ * the given number of frames wait while the next one renders, and
+ * htSwapGLBuffers blocks only while all of them are queued. The object for
+ * the next frame is bound by htCreateGLPresentThread and htSwapGLBuffers;
+ * code binding other framebuffers must restore GL_DRAW_FRAMEBUFFER_BINDING.
+ * Windows with sample buffers are rejected. GLX only.
+ *
+ * htSwapGLBuffersWithDamage uses EGL_KHR/EXT_swap_buffers_with_damage. GLX
+ * copies only the damage while the swap interval is 0, as those copies are
+ * not synchronized to vblank, and otherwise swaps the whole buffer.
+ *
+ * Software framebuffers are reallocated when the window size changes, while
+ * events are polled or on htAcquireFramebuffer, which drops their content.
+ * Query HT_WINDOW_FRAMEBUFFER and HT_WINDOW_PITCH again after either.
+ * Otherwise an acquired buffer always holds the last presented frame, so
+ * only the pixels passed as damage need to be drawn.
+ *
+ * Only implemented on X11, other platforms return HT_ERROR_UNSUPPORTED:
+ *   htCreateOffscreenWindow, htCreateSharedGLContexts,
+ *   htAcquireSharedGLContext, htReleaseSharedGLContext,
+ *   htCreateGLPresentThread, htDestroyGLPresentThread, htCreateFramebuffer,
+ *   htDestroyFramebuffer, htAcquireFramebuffer, htPresentFramebuffer,
+ *   htPresentFramebufferWithDamage, htPresentFramebufferAtMSC,
+ *   htSetInstanceErrorCallback.
+ *   htSwapGLBuffersWithDamage swaps the whole buffer there. */
+int htCreateInstance(HTInstance**, const char*);
+int htCreateWindow(HTWindow**, int, int, unsigned, unsigned);
+int htCreateWindows(HTWindow**, const HTWindowDesc*, unsigned);
+int htCreateOffscreenWindow(HTWindow**, HTInstance*, unsigned, unsigned);
 int htCreateGLContext(HTWindow*);
+int htCreateSharedGLContexts(HTWindow*, unsigned);
+int htCreateGLPresentThread(HTWindow*, unsigned);
 int htCreateInputManager(HTWindow*);
+int htCreateFramebuffer(HTWindow*);
+int htDestroyInstance(HTInstance**);
 int htDestroyWindow(HTWindow**);
 int htDestroyGLContext(HTWindow*);
+int htDestroyGLPresentThread(HTWindow*);
 int htDestroyInputManager(HTWindow*);
+int htDestroyFramebuffer(HTWindow*);
 int htSetCurrentGLContext(HTWindow*);
+int htAcquireSharedGLContext(HTWindow*);
+int htReleaseSharedGLContext(HTWindow*);
+int htAcquireFramebuffer(HTWindow*);
 int htSwapGLBuffers(HTWindow*);
+int htSwapGLBuffersWithDamage(HTWindow*, const HTRect*, unsigned);
+int htPresentFramebuffer(HTWindow*);
+int htPresentFramebufferWithDamage(HTWindow*, const HTRect*, unsigned);
+int htPresentFramebufferAtMSC(HTWindow*, unsigned long);
 int htPollWindowEvents(HTWindow*);
 int htPollInputEvents(HTWindow*);
 int htSetWindowInteger(HTWindow*, HTWindowAttribute, int);
+int htSetWindowIntegers(
+  HTWindow*, const HTWindowAttribute*, const int*, unsigned);
 int htSetWindowUntyped(HTWindow*, HTWindowAttribute, unsigned char*);
 int htGetWindowInteger(HTWindow*, HTWindowAttribute, int*);
 int htGetWindowUntyped(HTWindow*, HTWindowAttribute, unsigned char**);
 int htSetEventHandler(HTWindow*, HTEvent, HTEventHandler);
 int htSetWindowErrorCallback(HTWindowErrorCallback);
+int htSetInstanceErrorCallback(HTInstance*, HTWindowErrorCallback);
+int htGetMonitors(HTInstance*, HTMonitor*, unsigned*);
+/* htGetEventFds and htDispatchReady only have an effect on X11, other
+ * platforms report no descriptors and dispatch nothing. There
+ * htDispatchReady polls every window of the instance, so it must not run
+ * alongside other calls on those windows. Xlib may queue events while
+ * serving other calls, so dispatch once per frame as well as on readiness. */
+int htGetEventFds(HTInstance*, int*, unsigned*);
+int htDispatchReady(HTInstance*);
+int htSetFlushPolicy(HTInstance*, HTFlushPolicy);
+/* X11: between htBeginUpdate and htCommitUpdate the position, size, title
+ * and fullscreen state of the instance's windows are kept, then sent in one
+ * write when the outermost update commits. Other attributes apply at once. */
+int htBeginUpdate(HTInstance*);
+int htCommitUpdate(HTInstance*);
 
 #ifdef __cplusplus
 }
@@ -1,5 +1,6 @@
 /*------------------------------------------------------------------- HEADERS */
 
+#include <CoreGraphics/CGDirectDisplay.h>
 #include <CoreGraphics/CGEventSource.h>
 #include <IOKit/hid/IOHIDLib.h>
 #include <objc/message.h>
@@ -131,11 +132,11 @@ struct HTWindow {
     unsigned backing_store:  1; /* 0: No Backing Store, 1: Backing Store */
   } gl;
   struct {
-    int x:               14; /* X position of top-left corner */
-    int y:               14; /* Y position of top-left corner */
+    int x;                   /* X position of top-left corner */
+    int y;                   /* Y position of top-left corner */
+    unsigned width;          /* Width of the content area     */
+    unsigned height;         /* Height of the content area    */
     unsigned style:       4; /* Style mask of the window      */
-    unsigned width:      13; /* Width of the content area     */
-    unsigned height:     13; /* Height of the content area    */
     unsigned fullscreen:  1; /* Window is in fullscreen mode  */
     unsigned moving:      1; /* Window is currently moving    */
   } info;
@@ -146,6 +147,10 @@ struct HTWindow {
 #endif
 };
 
+struct HTInstance {
+  unsigned reserved; /* Cocoa connects to its window server implicitly */
+};
+
 /*---------------------------------------------------------- STATIC VARIABLES */
 
 static HTWindowErrorCallback ht_error_handler;
@@ -369,12 +374,15 @@ InitWindowDelegate() {
 
 int
 htCreateWindow(
-    HTWindow** window, short x, short y, unsigned short w, unsigned short h) {
+    HTWindow** window, int x, int y, unsigned w, unsigned h) {
   const char* func = "htCreateWindow";
   extern id NSApp;
   id delegate = NULL;
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(!*window, func, HT_ERROR_INVALID_ARGUMENT);
+  /* Empty windows are clamped like HT_WINDOW_WIDTH and HT_WINDOW_HEIGHT */
+  w = w ? w : 1;
+  h = h ? h : 1;
   if (!NSApp) {
     CLASS_SEND(objc_getClass("NSApplication"), sel_getUid("sharedApplication"));
     objc_msgSend(NSApp, sel_getUid("setActivationPolicy:"), 0);
@@ -421,6 +429,51 @@ htCreateWindow(
   return HT_ERROR_NONE;
 }
 
+int
+htCreateInstance(HTInstance** instance, const char* display) {
+  const char* func = "htCreateInstance";
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(!*instance, func, HT_ERROR_INVALID_ARGUMENT);
+  (void) display; /* Only one window server per session */
+  *instance = calloc(1, sizeof (HTInstance));
+  if (!*instance) return HANDLE_ERROR(func, HT_ERROR_MEMORY_ALLOCATION);
+  return HT_ERROR_NONE;
+}
+
+int
+htCreateWindows(HTWindow** window, const HTWindowDesc* desc, unsigned count) {
+  const char* func = "htCreateWindows";
+  unsigned i = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(desc || !count, func, HT_ERROR_INVALID_ARGUMENT);
+  for (i = 0; i < count; ++i) {
+    const int result = htCreateWindow(
+      &window[i], desc[i].x, desc[i].y, desc[i].width, desc[i].height);
+    if (result != HT_ERROR_NONE) {
+      /* Release every window of the batch created so far */
+      while (i--) htDestroyWindow(&window[i]);
+      return result;
+    }
+    if (desc[i].title) {
+      htSetWindowUntyped(
+        window[i], HT_WINDOW_TITLE, (unsigned char*) desc[i].title);
+    }
+  }
+  return HT_ERROR_NONE;
+}
+
+int
+htCreateOffscreenWindow(
+    HTWindow** window, HTInstance* instance, unsigned w, unsigned h) {
+  const char* func = "htCreateOffscreenWindow";
+  /* Offscreen windows are only implemented on X11 */
+  (void) window;
+  (void) instance;
+  (void) w;
+  (void) h;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htCreateGLContext(HTWindow* window) {
   const char* func = "htCreateGLContext";
@@ -522,6 +575,24 @@ htCreateGLContext(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htCreateSharedGLContexts(HTWindow* window, unsigned count) {
+  const char* func = "htCreateSharedGLContexts";
+  /* Shared context pools are only implemented on X11 */
+  (void) window;
+  (void) count;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htCreateGLPresentThread(HTWindow* window, unsigned frames) {
+  const char* func = "htCreateGLPresentThread";
+  /* Present threads are only implemented on X11 */
+  (void) window;
+  (void) frames;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htCreateInputManager(HTWindow* window) {
   const char* func = "htCreateInputManager";
@@ -554,6 +625,24 @@ htCreateInputManager(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htCreateFramebuffer(HTWindow* window) {
+  const char* func = "htCreateFramebuffer";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htDestroyInstance(HTInstance** instance) {
+  const char* func = "htDestroyInstance";
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(*instance, func, HT_ERROR_INVALID_ARGUMENT);
+  free(*instance);
+  *instance = NULL;
+  return HT_ERROR_NONE;
+}
+
 int
 htDestroyWindow(HTWindow** window) {
   const char* func = "htDestroyWindow";
@@ -582,6 +671,14 @@ htDestroyGLContext(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htDestroyGLPresentThread(HTWindow* window) {
+  const char* func = "htDestroyGLPresentThread";
+  /* Present threads are only implemented on X11 */
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htDestroyInputManager(HTWindow* window) {
   const char* func = "htDestroyInputManager";
@@ -593,6 +690,14 @@ htDestroyInputManager(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htDestroyFramebuffer(HTWindow* window) {
+  const char* func = "htDestroyFramebuffer";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htSetCurrentGLContext(HTWindow* window) {
   const char* func = "htSetCurrentGLContext";
@@ -603,6 +708,28 @@ htSetCurrentGLContext(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htAcquireSharedGLContext(HTWindow* window) {
+  const char* func = "htAcquireSharedGLContext";
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htReleaseSharedGLContext(HTWindow* window) {
+  const char* func = "htReleaseSharedGLContext";
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htAcquireFramebuffer(HTWindow* window) {
+  const char* func = "htAcquireFramebuffer";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htSwapGLBuffers(HTWindow* window) {
   const char* func = "htSwapGLBuffers";
@@ -613,6 +740,45 @@ htSwapGLBuffers(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htSwapGLBuffersWithDamage(
+    HTWindow* window, const HTRect* rect, unsigned count) {
+  const char* func = "htSwapGLBuffersWithDamage";
+  ASSERT(rect || !count, func, HT_ERROR_INVALID_ARGUMENT);
+  /* Damage is only a hint, the whole back buffer is swapped */
+  (void) rect;
+  (void) count;
+  return htSwapGLBuffers(window);
+}
+
+int
+htPresentFramebuffer(HTWindow* window) {
+  const char* func = "htPresentFramebuffer";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htPresentFramebufferWithDamage(
+    HTWindow* window, const HTRect* rect, unsigned count) {
+  const char* func = "htPresentFramebufferWithDamage";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  (void) rect;
+  (void) count;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htPresentFramebufferAtMSC(HTWindow* window, unsigned long msc) {
+  const char* func = "htPresentFramebufferAtMSC";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  (void) msc;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htSetWindowInteger(HTWindow* window, HTWindowAttribute type, int data) {
   const char* func = "htSetWindowInteger";
@@ -680,7 +846,7 @@ htSetWindowInteger(HTWindow* window, HTWindowAttribute type, int data) {
       window->gl.swap_interval = data != 0;
       break;
     case HT_WINDOW_HEIGHT:
-      window->info.height = data & 0x3FFF;
+      window->info.height = data < 1 ? 1 : data;
       SetWindowResolution(window);
       break;
     case HT_WINDOW_STYLE:
@@ -689,7 +855,7 @@ htSetWindowInteger(HTWindow* window, HTWindowAttribute type, int data) {
         window->win, sel_getUid("setStyleMask:"), window->info.style);
       break;
     case HT_WINDOW_WIDTH:
-      window->info.width = data & 0x3FFF;
+      window->info.width = data < 1 ? 1 : data;
       SetWindowResolution(window);
       break;
     case HT_WINDOW_X:
@@ -706,6 +872,24 @@ htSetWindowInteger(HTWindow* window, HTWindowAttribute type, int data) {
   return HT_ERROR_NONE;
 }
 
+int
+htSetWindowIntegers(
+    HTWindow* window,
+    const HTWindowAttribute* type,
+    const int* data,
+    unsigned count) {
+  const char* func = "htSetWindowIntegers";
+  unsigned i = 0;
+  int error = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  ASSERT((type && data) || !count, func, HT_ERROR_INVALID_ARGUMENT);
+  for (i = 0; i < count && !error; ++i) {
+    error = htSetWindowInteger(window, type[i], data[i]);
+  }
+  return error;
+}
+
 int
 htSetWindowUntyped(
     HTWindow* window, HTWindowAttribute type, unsigned char* data) {
@@ -802,6 +986,84 @@ htSetWindowErrorCallback(HTWindowErrorCallback callback) {
   return HT_ERROR_NONE;
 }
 
+int
+htSetInstanceErrorCallback(
+    HTInstance* instance, HTWindowErrorCallback callback) {
+  const char* func = "htSetInstanceErrorCallback";
+  /* Per-instance callbacks are only implemented on X11 */
+  (void) instance;
+  (void) callback;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htSetFlushPolicy(HTInstance* instance, HTFlushPolicy policy) {
+  /* AppKit batches its own window updates per run loop pass */
+  (void) instance;
+  (void) policy;
+  return HT_ERROR_NONE;
+}
+
+int
+htGetMonitors(HTInstance* instance, HTMonitor* monitor, unsigned* count) {
+  const char* func = "htGetMonitors";
+  CGDirectDisplayID display[HT_MAX_MONITORS];
+  uint32_t displays = 0;
+  unsigned i = 0;
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(count, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(monitor || !*count, func, HT_ERROR_INVALID_ARGUMENT);
+  if (CGGetActiveDisplayList(HT_MAX_MONITORS, display, &displays)) {
+    return HANDLE_ERROR(func, HT_ERROR_WINDOW_SERVER);
+  }
+  /* At most count monitors are copied, count returns how many exist */
+  for (i = 0; i < *count && i < displays; ++i) {
+    const CGRect bounds = CGDisplayBounds(display[i]);
+    CGDisplayModeRef mode = CGDisplayCopyDisplayMode(display[i]);
+    /* Global display space has its origin top-left on the main display */
+    monitor[i].x       = (int) bounds.origin.x;
+    monitor[i].y       = (int) bounds.origin.y;
+    monitor[i].width   = (unsigned) bounds.size.width;
+    monitor[i].height  = (unsigned) bounds.size.height;
+    monitor[i].primary = CGDisplayIsMain(display[i]) != 0;
+    /* Built-in panels may report 0 Hz, which leaves the rate unknown */
+    monitor[i].refresh = mode ?
+      (unsigned) (CGDisplayModeGetRefreshRate(mode) * 1000.0 + 0.5) : 0;
+    if (mode) CGDisplayModeRelease(mode);
+  }
+  *count = displays;
+  return HT_ERROR_NONE;
+}
+
+int
+htGetEventFds(HTInstance* instance, int* fd, unsigned* count) {
+  const char* func = "htGetEventFds";
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(count, func, HT_ERROR_INVALID_ARGUMENT);
+  /* Window messages are not delivered through file descriptors */
+  (void) fd;
+  *count = 0;
+  return HT_ERROR_NONE;
+}
+
+int
+htDispatchReady(HTInstance* instance) {
+  (void) instance;
+  return HT_ERROR_NONE;
+}
+
+int
+htBeginUpdate(HTInstance* instance) {
+  (void) instance;
+  return HT_ERROR_NONE;
+}
+
+int
+htCommitUpdate(HTInstance* instance) {
+  (void) instance;
+  return HT_ERROR_NONE;
+}
+
 int
 htPollWindowEvents(HTWindow* window) {
   const char* func = "htPollWindowEvents";
@@ -206,17 +206,17 @@ struct HTWindow {
     unsigned backing_store:  1; /* 0: No Backing Store, 1: Backing Store */
   } gl;
   struct {
-    int x:               14; /* X position of top-left corner */
-    int y:               14; /* Y position of top-left corner */
+    int x;                   /* X position of top-left corner */
+    int y;                   /* Y position of top-left corner */
+    unsigned width;          /* Width of the content area     */
+    unsigned height;         /* Height of the content area    */
     int titled:           1; /* Window has title bar          */
     int closable:         1; /* Window has close button       */
     int miniaturizable:   1; /* Window has minimize button    */
     int resizable:        1; /* Window has resize button      */
-    unsigned width:      13; /* Width of the content area     */
-    unsigned height:     13; /* Height of the content area    */
     unsigned fullscreen:  1; /* Window is in fullscreen mode  */
     unsigned moving:      1; /* Window is currently moving    */
-    const int padding:    4;
+    const int padding:   26;
   } info;
   unsigned char*   user; /* Pointer to user-supplied data    */
   HDC   hdc;  /* Handle to a Win32 device context */
@@ -226,6 +226,16 @@ struct HTWindow {
 #endif
 };
 
+struct HTInstance {
+  unsigned reserved; /* Win32 connects to its window server implicitly */
+};
+
+struct MonitorList {
+  HTMonitor* monitor;  /* Monitors copied for the caller        */
+  unsigned   capacity; /* Monitors the caller has room for      */
+  unsigned   count;    /* Monitors enumerated, copied or not    */
+};
+
 /*---------------------------------------------------------- STATIC VARIABLES */
 
 static HTWindowErrorCallback ht_error_handler;
@@ -403,8 +413,9 @@ WMCreate(HTWindow* window, HWND hwnd, LPARAM lparam) {
 
 static int
 WMMove(HTWindow* window, LPARAM lparam) {
-  window->info.x = LOWORD(lparam);
-  window->info.y = HIWORD(lparam);
+  /* Positions left of or above the primary monitor are negative */
+  window->info.x = GET_X_LPARAM(lparam);
+  window->info.y = GET_Y_LPARAM(lparam);
   HT_HANDLE_EVENT(window, window->event.move);
   return HT_ERROR_NONE;
 }
@@ -461,6 +472,38 @@ WMInput(HTWindow* window, LPARAM lparam) {
 }
 #endif
 
+static BOOL CALLBACK
+monitorproc(HMONITOR hmonitor, HDC hdc, LPRECT rect, LPARAM lparam) {
+  struct MonitorList* list = (struct MonitorList*) lparam;
+  HTMonitor* monitor = NULL;
+  MONITORINFOEX info;
+  DEVMODE mode;
+  (void) hdc;
+  (void) rect;
+  if (list->count >= list->capacity) {
+    ++list->count;
+    return TRUE;
+  }
+  monitor = &list->monitor[list->count++];
+  ZeroMemory(monitor, sizeof (*monitor));
+  ZeroMemory(&info, sizeof (info));
+  info.cbSize = sizeof (info);
+  if (!GetMonitorInfo(hmonitor, (LPMONITORINFO) &info)) return TRUE;
+  monitor->x       = info.rcMonitor.left;
+  monitor->y       = info.rcMonitor.top;
+  monitor->width   = info.rcMonitor.right  - info.rcMonitor.left;
+  monitor->height  = info.rcMonitor.bottom - info.rcMonitor.top;
+  monitor->primary = (info.dwFlags & MONITORINFOF_PRIMARY) != 0;
+  ZeroMemory(&mode, sizeof (mode));
+  mode.dmSize = sizeof (mode);
+  /* Frequencies of 0 and 1 stand for the hardware default, so unknown */
+  if (EnumDisplaySettings(info.szDevice, ENUM_CURRENT_SETTINGS, &mode) &&
+      mode.dmDisplayFrequency > 1) {
+    monitor->refresh = mode.dmDisplayFrequency * 1000;
+  }
+  return TRUE;
+}
+
 static LRESULT CALLBACK
 wndproc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam) {
   HTWindow* window = (HTWindow*) GetWindowLongPtr(hwnd, GWLP_USERDATA);
@@ -483,10 +526,13 @@ wndproc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam) {
 
 int
 htCreateWindow(
-    HTWindow** window, short x, short y, unsigned short w, unsigned short h) {
+    HTWindow** window, int x, int y, unsigned w, unsigned h) {
   const char* func = "htCreateWindow";
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(!*window, func, HT_ERROR_INVALID_ARGUMENT);
+  /* Empty windows are clamped like HT_WINDOW_WIDTH and HT_WINDOW_HEIGHT */
+  w = w ? w : 1;
+  h = h ? h : 1;
   *window = calloc(1, sizeof (HTWindow));
   if (!*window) {
     return HANDLE_ERROR(func, HT_ERROR_MEMORY_ALLOCATION);
@@ -525,6 +571,51 @@ htCreateWindow(
   return HT_ERROR_NONE;
 }
 
+int
+htCreateInstance(HTInstance** instance, const char* display) {
+  const char* func = "htCreateInstance";
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(!*instance, func, HT_ERROR_INVALID_ARGUMENT);
+  (void) display; /* Only one window server per session */
+  *instance = calloc(1, sizeof (HTInstance));
+  if (!*instance) return HANDLE_ERROR(func, HT_ERROR_MEMORY_ALLOCATION);
+  return HT_ERROR_NONE;
+}
+
+int
+htCreateWindows(HTWindow** window, const HTWindowDesc* desc, unsigned count) {
+  const char* func = "htCreateWindows";
+  unsigned i = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(desc || !count, func, HT_ERROR_INVALID_ARGUMENT);
+  for (i = 0; i < count; ++i) {
+    const int result = htCreateWindow(
+      &window[i], desc[i].x, desc[i].y, desc[i].width, desc[i].height);
+    if (result != HT_ERROR_NONE) {
+      /* Release every window of the batch created so far */
+      while (i--) htDestroyWindow(&window[i]);
+      return result;
+    }
+    if (desc[i].title) {
+      htSetWindowUntyped(
+        window[i], HT_WINDOW_TITLE, (unsigned char*) desc[i].title);
+    }
+  }
+  return HT_ERROR_NONE;
+}
+
+int
+htCreateOffscreenWindow(
+    HTWindow** window, HTInstance* instance, unsigned w, unsigned h) {
+  const char* func = "htCreateOffscreenWindow";
+  /* Offscreen windows are only implemented on X11 */
+  (void) window;
+  (void) instance;
+  (void) w;
+  (void) h;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htCreateGLContext(HTWindow* window) {
   const char* func = "htInitGLContext";
@@ -647,6 +738,24 @@ htCreateGLContext(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htCreateSharedGLContexts(HTWindow* window, unsigned count) {
+  const char* func = "htCreateSharedGLContexts";
+  /* Shared context pools are only implemented on X11 */
+  (void) window;
+  (void) count;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htCreateGLPresentThread(HTWindow* window, unsigned frames) {
+  const char* func = "htCreateGLPresentThread";
+  /* Present threads are only implemented on X11 */
+  (void) window;
+  (void) frames;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htCreateInputManager(HTWindow* window) {
   const char* func = "htCreateInputManager";
@@ -674,6 +783,24 @@ htCreateInputManager(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htCreateFramebuffer(HTWindow* window) {
+  const char* func = "htCreateFramebuffer";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htDestroyInstance(HTInstance** instance) {
+  const char* func = "htDestroyInstance";
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(*instance, func, HT_ERROR_INVALID_ARGUMENT);
+  free(*instance);
+  *instance = NULL;
+  return HT_ERROR_NONE;
+}
+
 int
 htDestroyWindow(HTWindow** window) {
   const char* func = "htDestroyWindow";
@@ -703,6 +830,14 @@ htDestroyGLContext(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htDestroyGLPresentThread(HTWindow* window) {
+  const char* func = "htDestroyGLPresentThread";
+  /* Present threads are only implemented on X11 */
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htDestroyInputManager(HTWindow* window) {
   const char* func = "htDestroyWindow";
@@ -735,6 +870,14 @@ htDestroyInputManager(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htDestroyFramebuffer(HTWindow* window) {
+  const char* func = "htDestroyFramebuffer";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htSetCurrentGLContext(HTWindow* window) {
   const char* func = "htSetCurrentGLContext";
@@ -745,6 +888,28 @@ htSetCurrentGLContext(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htAcquireSharedGLContext(HTWindow* window) {
+  const char* func = "htAcquireSharedGLContext";
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htReleaseSharedGLContext(HTWindow* window) {
+  const char* func = "htReleaseSharedGLContext";
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htAcquireFramebuffer(HTWindow* window) {
+  const char* func = "htAcquireFramebuffer";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htSwapGLBuffers(HTWindow* window) {
   const char* func = "htSwapGLBuffers";
@@ -754,6 +919,45 @@ htSwapGLBuffers(HTWindow* window) {
   return HT_ERROR_NONE;
 }
 
+int
+htSwapGLBuffersWithDamage(
+    HTWindow* window, const HTRect* rect, unsigned count) {
+  const char* func = "htSwapGLBuffersWithDamage";
+  ASSERT(rect || !count, func, HT_ERROR_INVALID_ARGUMENT);
+  /* Damage is only a hint, the whole back buffer is swapped */
+  (void) rect;
+  (void) count;
+  return htSwapGLBuffers(window);
+}
+
+int
+htPresentFramebuffer(HTWindow* window) {
+  const char* func = "htPresentFramebuffer";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htPresentFramebufferWithDamage(
+    HTWindow* window, const HTRect* rect, unsigned count) {
+  const char* func = "htPresentFramebufferWithDamage";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  (void) rect;
+  (void) count;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htPresentFramebufferAtMSC(HTWindow* window, unsigned long msc) {
+  const char* func = "htPresentFramebufferAtMSC";
+  /* Software framebuffers are only implemented on X11 */
+  (void) window;
+  (void) msc;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
 int
 htSetWindowInteger(HTWindow* window, HTWindowAttribute type, int data) {
   const char* func = "htSetWindowInteger";
@@ -820,11 +1024,11 @@ htSetWindowInteger(HTWindow* window, HTWindowAttribute type, int data) {
       window->gl.swap_interval = data != 0;
       break;
     case HT_WINDOW_HEIGHT:
-      window->info.height = data & 0x3FFF;
+      window->info.height = data < 1 ? 1 : data;
       SetWindowResolution(window);
       break;
     case HT_WINDOW_WIDTH:
-      window->info.width = data & 0x3FFF;
+      window->info.width = data < 1 ? 1 : data;
       SetWindowResolution(window);
       break;
     case HT_WINDOW_STYLE:
@@ -847,6 +1051,24 @@ htSetWindowInteger(HTWindow* window, HTWindowAttribute type, int data) {
   return HT_ERROR_NONE;
 }
 
+int
+htSetWindowIntegers(
+    HTWindow* window,
+    const HTWindowAttribute* type,
+    const int* data,
+    unsigned count) {
+  const char* func = "htSetWindowIntegers";
+  unsigned i = 0;
+  int error = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  ASSERT((type && data) || !count, func, HT_ERROR_INVALID_ARGUMENT);
+  for (i = 0; i < count && !error; ++i) {
+    error = htSetWindowInteger(window, type[i], data[i]);
+  }
+  return error;
+}
+
 int
 htSetWindowUntyped(
     HTWindow* window, HTWindowAttribute type, unsigned char* data) {
@@ -952,6 +1174,70 @@ htSetWindowErrorCallback(HTWindowErrorCallback callback) {
   return HT_ERROR_NONE;
 }
 
+int
+htSetInstanceErrorCallback(
+    HTInstance* instance, HTWindowErrorCallback callback) {
+  const char* func = "htSetInstanceErrorCallback";
+  /* Per-instance callbacks are only implemented on X11 */
+  (void) instance;
+  (void) callback;
+  return HANDLE_ERROR(func, HT_ERROR_UNSUPPORTED);
+}
+
+int
+htSetFlushPolicy(HTInstance* instance, HTFlushPolicy policy) {
+  /* Win32 calls are not buffered, so there is nothing to flush */
+  (void) instance;
+  (void) policy;
+  return HT_ERROR_NONE;
+}
+
+int
+htGetMonitors(HTInstance* instance, HTMonitor* monitor, unsigned* count) {
+  const char* func = "htGetMonitors";
+  struct MonitorList list = {0};
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(count, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(monitor || !*count, func, HT_ERROR_INVALID_ARGUMENT);
+  /* At most count monitors are copied, count returns how many exist */
+  list.monitor  = monitor;
+  list.capacity = *count;
+  if (!EnumDisplayMonitors(NULL, NULL, monitorproc, (LPARAM) &list)) {
+    return HANDLE_ERROR(func, HT_ERROR_WINDOW_SERVER);
+  }
+  *count = list.count;
+  return HT_ERROR_NONE;
+}
+
+int
+htGetEventFds(HTInstance* instance, int* fd, unsigned* count) {
+  const char* func = "htGetEventFds";
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(count, func, HT_ERROR_INVALID_ARGUMENT);
+  /* Window messages are not delivered through file descriptors */
+  (void) fd;
+  *count = 0;
+  return HT_ERROR_NONE;
+}
+
+int
+htDispatchReady(HTInstance* instance) {
+  (void) instance;
+  return HT_ERROR_NONE;
+}
+
+int
+htBeginUpdate(HTInstance* instance) {
+  (void) instance;
+  return HT_ERROR_NONE;
+}
+
+int
+htCommitUpdate(HTInstance* instance) {
+  (void) instance;
+  return HT_ERROR_NONE;
+}
+
 int
 htPollWindowEvents(HTWindow* window) {
   const char* func = "htPollWindowEvents";
@@ -1,16 +1,55 @@
 /*------------------------------------------------------------------- HEADERS */
 
+#define _XOPEN_SOURCE 500 /* Recursive mutexes under C89 */
+#ifdef HT_USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#else
 #include <GL/glx.h>
+#endif
+#if defined __GNUC__ && (defined __i386__ || defined __x86_64__)
+#define HT_SIMD_X86
+#include <immintrin.h>
+#endif
+#include <X11/extensions/Xfixes.h>
 #include <X11/extensions/XInput2.h>
+#include <X11/extensions/Xpresent.h>
+#include <X11/extensions/Xrandr.h>
+#include <X11/extensions/XShm.h>
+#include <X11/Xatom.h>
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include "window.h"
 
 /*-------------------------------------------------------------------- MACROS */
 
-#define HT_EVENT_MASK (FocusChangeMask | StructureNotifyMask)
+#define HT_EVENT_MASK\
+  (ExposureMask | FocusChangeMask | StructureNotifyMask | PropertyChangeMask)
+#define HT_GL_CONFIG_CACHE_SIZE 8  /* Must be a power of 2            */
+#define HT_GL_PFA_SIZE          37 /* Pixel format attribute list size */
+#define HT_GL_PFA_CAVEAT        29 /* Index of the config caveat value */
+#define HT_GL_DAMAGE_SIZE       16 /* Damage rectangles passed to GL   */
+#define HT_GL_FRAME_SLOTS (HT_MAX_GL_FRAMES_IN_FLIGHT + 1) /* Plus rendered */
+#define HT_MAX_X11_SIZE     0xFFFF /* Largest window size in protocol  */
+#define HT_MAX_X11_POSITION 0x7FFF /* Largest coordinate in protocol   */
 #define HT_INPUT_QUEUE_BITS  4
 #define HT_INPUT_QUEUE_SIZE (1 << HT_INPUT_QUEUE_BITS)
+#define HT_INPUT_BACKLOG   256 /* Raw events kept queued between polls */
+#define HT_PROBE_FRAMEBUFFER 0x1 /* MIT-SHM and Present were queried */
+#define HT_PROBE_RANDR       0x2 /* RandR was queried                */
+#define HT_PROBE_COMPOSITOR  0x4 /* XFixes selection was queried     */
+#define HT_STAGE_TITLE       0x1 /* Title waits for the update       */
+#define HT_STAGE_FULLSCREEN  0x2 /* Fullscreen waits for the update  */
+#define HT_CLAMP_SIZE(size) HT_MIN(HT_MAX((size), 1), HT_MAX_X11_SIZE)
+#define HT_CLAMP_POSITION(position)\
+  HT_MIN(HT_MAX((position), -HT_MAX_X11_POSITION - 1), HT_MAX_X11_POSITION)
 #define HT_INPUT_QUEUE_PREV(index) (((index) - 1) & (HT_INPUT_QUEUE_SIZE - 1))
 #define HEAD_MOUSE_BUTTON(window) (window)->hid.mouse.button[(window)->hid.head]
 #define HEAD_MOUSE_X(window)      (window)->hid.mouse.x[(window)->hid.head]
@@ -25,8 +64,17 @@
 #define PREV_MOUSE_BUTTON(window)\
   (window)->hid.mouse.button[HT_INPUT_QUEUE_PREV((window)->hid.tail)]
 
+#ifdef HT_SIMD_X86
+#define TARGET(isa) __attribute__((target(isa)))
+#endif
 #define HANDLE_ERROR(func, result)\
-  htHandleError(__FILE__, func, __LINE__, result)
+  htHandleError(NULL, __FILE__, func, __LINE__, result)
+#define INSTANCE_ERROR(instance, func, result)\
+  htHandleError((instance), __FILE__, func, __LINE__, result)
+#define LOCK()\
+  pthread_once(&ht_once, htInitThreads);\
+  pthread_mutex_lock(&ht_lock)
+#define UNLOCK() pthread_mutex_unlock(&ht_lock)
 #define HT_HANDLE_EVENT(window, callback) if (callback) (callback)(window)
 #define INIT_GL_DEFAULTS(window)\
   (window)->gl.color          = HT_DEFAULT_GL_COLOR_BUFFER;\
@@ -58,19 +106,127 @@
 #define ASSERT(exp, func, result) (void) func
 #endif
 
+#ifdef HT_USE_EGL
+#define LOAD_EGL(type, name)\
+  const type name = (type) eglGetProcAddress(#name)
+#define GL_DPY(window) (window)->instance->egl_dpy
+#define PF_CAVEAT_ANY    EGL_DONT_CARE
+#define PF_CAVEAT_NONE   EGL_NONE
+#define PF_DRAWABLE_TYPE EGL_SURFACE_TYPE
+#define PF_PBUFFER_BIT   EGL_PBUFFER_BIT
+#define PF_RGBA_BIT      EGL_OPENGL_BIT
+#define PF_VISUAL_ID     EGL_NATIVE_VISUAL_ID
+#define PF_WINDOW_BIT    EGL_WINDOW_BIT
+#define GET_CONFIG_ATTRIB(display, config, name, value)\
+  eglGetConfigAttrib((display), (config), (name), (value))
+#define BIND_API()             eglBindAPI(EGL_OPENGL_API)
+#define GET_CURRENT_CONTEXT()  eglGetCurrentContext()
+#define GET_CURRENT_DRAWABLE() eglGetCurrentSurface(EGL_DRAW)
+#define MAKE_CURRENT(display, drawable, context)\
+  eglMakeCurrent((display), (drawable), (drawable), (context))
+#define DESTROY_CONTEXT(display, context)\
+  eglDestroyContext((display), (context))
+#define DESTROY_PBUFFER(display, pbuffer)\
+  eglDestroySurface((display), (pbuffer))
+#define SWAP_BUFFERS(display, drawable) eglSwapBuffers((display), (drawable))
+#else
 #define LOAD_GLX(type, name)\
   const type name = (type) glXGetProcAddress((const GLubyte*) #name)
-#define MOVE_RESIZE_WINDOW(dpy, window)\
-  XMoveResizeWindow(\
-    (dpy),\
-    (window)->win,\
-    (window)->info.x,\
-    (window)->info.y,\
-    (window)->info.width,\
-    (window)->info.height)
+#define GL_DPY(window) (window)->instance->dpy
+#define PF_CAVEAT_ANY    GLX_DONT_CARE
+#define PF_CAVEAT_NONE   GLX_NONE
+#define PF_DRAWABLE_TYPE GLX_DRAWABLE_TYPE
+#define PF_PBUFFER_BIT   GLX_PBUFFER_BIT
+#define PF_RGBA_BIT      GLX_RGBA_BIT
+#define PF_VISUAL_ID     GLX_VISUAL_ID
+#define PF_WINDOW_BIT    GLX_WINDOW_BIT
+#define GET_CONFIG_ATTRIB(display, config, name, value)\
+  glXGetFBConfigAttrib((display), (config), (name), (value))
+#define BIND_API()             1
+#define GET_CURRENT_CONTEXT()  glXGetCurrentContext()
+#define GET_CURRENT_DRAWABLE() glXGetCurrentDrawable()
+#define MAKE_CURRENT(display, drawable, context)\
+  glXMakeContextCurrent((display), (drawable), (drawable), (context))
+#define DESTROY_CONTEXT(display, context)\
+  glXDestroyContext((display), (context))
+#define DESTROY_PBUFFER(display, pbuffer)\
+  glXDestroyPbuffer((display), (pbuffer))
+#define SWAP_BUFFERS(display, drawable) glXSwapBuffers((display), (drawable))
+#endif
+#define DPY(window)      (window)->instance->dpy
+#define FB_IMAGE(window) (window)->fb.buffer[(window)->fb.current].image
 
 /*------------------------------------------------------------------- STRUCTS */
 
+#ifdef HT_USE_EGL
+typedef EGLContext htGLContext;  /* OpenGL context                     */
+typedef EGLConfig  htGLConfig;   /* Framebuffer configuration          */
+typedef EGLSurface htGLDrawable; /* Surface rendered to by a context   */
+#else
+typedef GLXContext  htGLContext;  /* OpenGL context                    */
+typedef GLXFBConfig htGLConfig;   /* Framebuffer configuration         */
+typedef GLXDrawable htGLDrawable; /* Window or pbuffer of a context    */
+#endif
+
+/* Converts a row of user pixels into the BGRX layout of the image */
+typedef void (*htConvertRow)(unsigned char*, const unsigned char*, unsigned);
+
+/* Windows of an instance, copied so predicates need not take ht_lock */
+typedef struct htWindowList {
+  HTInstance*          instance; /* Instance owning the windows    */
+  Window*              win;      /* IDs of its windows at the time */
+  const unsigned char* fb;       /* Whether each has a framebuffer */
+  unsigned             count;    /* Number of IDs in win           */
+} htWindowList;
+
+/* Raw events queued for an XInput opcode, counted by a predicate */
+typedef struct htRawCount {
+  int opcode; /* Major opcode of the XInput extension */
+  int count;  /* Raw events found in the queue        */
+} htRawCount;
+
+struct HTInstance {
+  Display*   dpy;               /* Connection for windows and input    */
+#ifdef HT_USE_EGL
+  EGLDisplay egl_dpy;           /* EGL display on X11 or surfaceless   */
+  PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC eglSwapBuffersWithDamage;
+#else
+  PFNGLXCOPYSUBBUFFERMESAPROC glXCopySubBufferMESA;
+#endif
+  Atom       wm_delete_window;  /* Cached WM_DELETE_WINDOW atom        */
+  Atom       wm_state;          /* Cached _NET_WM_STATE atom           */
+  Atom       wm_fullscreen;     /* Cached _NET_WM_STATE_FULLSCREEN     */
+  Atom       wm_bypass;         /* Cached _NET_WM_BYPASS_COMPOSITOR    */
+  Atom       wm_cm;             /* Compositing manager selection       */
+  Window     cm_owner;          /* Cached owner of wm_cm, None if none */
+  int        shm_completion;    /* ShmCompletion event type, 0 if none */
+  int        present_opcode;    /* Present extension opcode, 0 if none */
+  int        rr_event;          /* RandR event base, 0 if none         */
+  int        fixes_event;       /* XFixes event base, 0 if none        */
+  int        xi_opcode;         /* XInput opcode, 0 until first used   */
+  HTMonitor  monitor[HT_MAX_MONITORS]; /* Cached RandR monitor list    */
+  unsigned   monitors;          /* Number of cached monitors           */
+  unsigned   stale;             /* Monitor list must be rebuilt        */
+  unsigned   probed;            /* HT_PROBE_* extensions queried       */
+  HTWindow*  windows;           /* Registry of live windows            */
+  unsigned   refs;              /* References held by user and windows */
+  char*      name;              /* Display name, or NULL for $DISPLAY  */
+  HTWindowErrorCallback error;  /* Callback for errors of its windows  */
+  unsigned   flush;             /* HTFlushPolicy of the connection     */
+  unsigned   update;            /* Nesting depth of open updates       */
+  HTWindow** snapshot;          /* Windows seen by htDispatchReady     */
+  Window*    snapshot_win;      /* IDs of the windows in snapshot      */
+  unsigned char* snapshot_fb;   /* Framebuffer state of those windows  */
+  unsigned   snapshot_size;     /* Capacity of the snapshot buffers    */
+  Cursor     blank;             /* Invisible cursor of grabbed windows */
+  struct {
+    int        pfa[HT_GL_PFA_SIZE];    /* Requested pixel format attributes */
+    int        attrib[HT_GL_PFA_SIZE]; /* Decoded attributes of the config  */
+    htGLConfig fbc;                    /* Chosen framebuffer configuration  */
+  } gl_config[HT_GL_CONFIG_CACHE_SIZE]; /* Cache of chosen configurations   */
+  unsigned gl_config_next;              /* Next cache entry to be replaced  */
+};
+
 struct HTWindow {
   struct {
     struct {
@@ -86,6 +242,10 @@ struct HTWindow {
     const int reserved: (sizeof (int) << 3) - (HT_INPUT_QUEUE_BITS << 1);
 #endif
     int opcode;
+    unsigned grab;    /* Pointer is captured whenever the window has focus */
+    unsigned grabbed; /* Pointer is currently captured by the window       */
+    int      device;  /* Device whose valuator mode is cached              */
+    int      relative;/* Cached device reports relative motion             */
   } hid;
   struct {
     HTEventHandler close;    /* Window was signaled to close       */
@@ -97,9 +257,10 @@ struct HTWindow {
     HTEventHandler keyboard; /* Keyboard was pressed/release       */
     HTEventHandler mouse;    /* Mouse was moved/clicked            */
     HTEventHandler gamepad;  /* Gamepad was pressed/released/moved */
+    HTEventHandler present;  /* Presented frame reached the screen */
   } event;
   struct {
-    GLXContext context;         /* GLX OpenGL context                    */
+    htGLContext context;        /* GLX or EGL OpenGL context             */
     unsigned color:          6; /* 0 -  32: RGBA buffer size             */
     unsigned red:            4; /* 0 -   8: Red bits                     */
     unsigned green:          4; /* 0 -   8: Green bits                   */
@@ -120,17 +281,88 @@ struct HTWindow {
     unsigned major:          4; /* 0 -   9: OpenGL major version         */
     unsigned minor:          4; /* 0 -   9: OpenGL minor version         */
     unsigned backing_store:  1; /* 0: No Backing Store, 1: Backing Store */
+    unsigned footprint:     16; /* Estimated framebuffer bits per pixel  */
+    htGLConfig config;          /* Framebuffer configuration of context  */
+    htGLDrawable drawable;      /* Surface the context renders into      */
   } gl;
   struct {
-    int x:               14; /* X position of top-left corner */
-    int y:               14; /* Y position of top-left corner */
+    htGLContext*    context; /* Contexts sharing objects with gl.context */
+    htGLDrawable*   pbuffer; /* Drawable made current with each context  */
+    unsigned char*  busy;    /* Context is current on a worker thread    */
+    unsigned        count;   /* Number of pooled contexts                */
+    pthread_mutex_t lock;    /* Guards busy flags across worker threads  */
+  } pool;
+  struct {
+    htGLContext     context; /* Context current on the present thread  */
+    GLsync          fence[HT_GL_FRAME_SLOTS];  /* Frame finished rendering */
+    GLuint          fbo[HT_GL_FRAME_SLOTS];    /* Frame objects rendered to */
+    GLuint          color[HT_GL_FRAME_SLOTS];  /* Color renderbuffers       */
+    GLuint          depth[HT_GL_FRAME_SLOTS];  /* Depth/stencil, 0 if none  */
+    unsigned        width[HT_GL_FRAME_SLOTS];  /* Size of each queued frame */
+    unsigned        height[HT_GL_FRAME_SLOTS];
+    unsigned        slots;   /* Frame objects, one more than in flight */
+    unsigned        head;    /* Next frame to be presented             */
+    unsigned        tail;    /* Frame being rendered on the caller     */
+    unsigned        frames;  /* Frames allowed in flight               */
+    unsigned        quit;    /* Present thread drains queue and exits  */
+    pthread_t       thread;  /* Thread swapping the buffers            */
+    pthread_mutex_t lock;    /* Guards the queue across both threads   */
+    pthread_cond_t  queued;  /* Signaled when a frame was enqueued     */
+    pthread_cond_t  done;    /* Signaled when a frame was presented    */
+    PFNGLFENCESYNCPROC               glFenceSync;
+    PFNGLCLIENTWAITSYNCPROC          glClientWaitSync;
+    PFNGLDELETESYNCPROC              glDeleteSync;
+    PFNGLGENFRAMEBUFFERSPROC         glGenFramebuffers;
+    PFNGLDELETEFRAMEBUFFERSPROC      glDeleteFramebuffers;
+    PFNGLBINDFRAMEBUFFERPROC         glBindFramebuffer;
+    PFNGLFRAMEBUFFERRENDERBUFFERPROC glFramebufferRenderbuffer;
+    PFNGLCHECKFRAMEBUFFERSTATUSPROC  glCheckFramebufferStatus;
+    PFNGLGENRENDERBUFFERSPROC        glGenRenderbuffers;
+    PFNGLDELETERENDERBUFFERSPROC     glDeleteRenderbuffers;
+    PFNGLBINDRENDERBUFFERPROC        glBindRenderbuffer;
+    PFNGLRENDERBUFFERSTORAGEPROC     glRenderbufferStorage;
+    PFNGLBLITFRAMEBUFFERPROC         glBlitFramebuffer;
+  } present;
+  struct {
+    struct {
+      XImage*         image; /* CPU-rendered pixels of the content area */
+      XShmSegmentInfo shm;   /* Segment of image, shmaddr NULL if none  */
+      Pixmap          pixmap;/* Pixmap sharing the segment for Present  */
+      unsigned        busy;  /* Server may still read the image         */
+      unsigned long   shown; /* Serial it was last presented with       */
+    } buffer[HT_MAX_FRAMEBUFFERS];
+    int             damage[HT_MAX_FRAMEBUFFERS][4]; /* Box per serial   */
+    HTPresentInfo   info;    /* Timing of the last completed present    */
+    unsigned long   serial;  /* Number of the last presented frame       */
+    unsigned        done;    /* Present completed since the last poll   */
+    XID             eid;     /* Present event selection, None if unused */
+    unsigned        count;   /* Number of buffers in the ring           */
+    unsigned        current; /* Buffer the user renders into            */
+    unsigned        last;    /* Buffer presented last                   */
+    unsigned        buffers; /* Number of buffers to create             */
+    GC              gc;      /* Graphics context used to present images */
+    unsigned char*  pixels;  /* User pixels if they need a conversion   */
+    unsigned        pitch;   /* Bytes per row of the user pixels        */
+    unsigned        format;  /* HTPixelFormat of the user pixels        */
+    htConvertRow    convert; /* Kernel converting pixels into image     */
+  } fb;
+  struct {
+    int x;                   /* X position of top-left corner */
+    int y;                   /* Y position of top-left corner */
+    unsigned width;          /* Width of the content area     */
+    unsigned height;         /* Height of the content area    */
     unsigned style:       4; /* Style mask of the window      */
-    unsigned width:      13; /* Width of the content area     */
-    unsigned height:     13; /* Height of the content area    */
     unsigned focus:       1; /* Window is currently in focus  */
     unsigned fullscreen:  1; /* Window is in fullscreen mode  */
+    unsigned pending:     1; /* Fullscreen request is pending */
   } info;
   unsigned char* user;   /* Pointer to user-supplied data */
+  HTInstance* instance;  /* Instance owning the window    */
+  HTWindow* next;        /* Next window of the instance   */
+  unsigned configure;    /* Geometry staged by an update  */
+  unsigned staged;       /* HT_STAGE_* flags of an update */
+  char* title;           /* Title staged by an update     */
+  long mask;             /* Core events selected          */
   Window win; /* ID of the X11 window          */
 #ifndef HT_DISABLE_DEBUG
   unsigned uid; /* Used to verify that the window was properly initialized */
@@ -140,20 +372,43 @@ struct HTWindow {
 /*---------------------------------------------------------- STATIC VARIABLES */
 
 static HTWindowErrorCallback ht_error_handler;
-static Display* dpy;    /* Display connection for X11 windows */
-static Display* xi_dpy; /* Display connection for XInput      */
+static pthread_once_t  ht_once = PTHREAD_ONCE_INIT; /* Thread setup guard */
+static pthread_mutex_t ht_lock; /* Recursive lock for instance state    */
+static HTInstance* ht_instance; /* Instance of windows created without one */
+static int ht_x_error;          /* Error code caught by htCatchXError       */
 
 /*----------------------------------------------------------------- FUNCTIONS */
 
+static void
+htInitThreads(void) {
+  pthread_mutexattr_t attr;
+  /* Must precede every other Xlib call to make connections thread-safe */
+  XInitThreads();
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&ht_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
 static int
-htHandleError(const char* file, const char* func, unsigned line, int result) {
-  if (ht_error_handler) {
+htHandleError(
+    HTInstance* instance,
+    const char* file,
+    const char* func,
+    unsigned line,
+    int result) {
+  HTWindowErrorCallback handler = NULL;
+  /* Errors of an instance fall back to the global callback */
+  LOCK();
+  handler = instance && instance->error ? instance->error : ht_error_handler;
+  UNLOCK();
+  if (handler) {
     htErrorInfo info = {0};
     info.file = (char*) file;
     info.function = (char*) func;
     info.line = line;
     info.result = result;
-    ht_error_handler(&info);
+    handler(&info);
   }
   return result;
 }
@@ -177,11 +432,72 @@ htReadMouseXY(HTWindow* window, const XIRawEvent* raw) {
 
 static int
 htIsRelative(HTWindow* window) {
+  const int id = window->hid.id[window->hid.head];
+  XIDeviceInfo* device = NULL;
+  int count = 0;
   int i = 0;
-  const XIDeviceInfo* device =
-    XIQueryDevice(xi_dpy, window->hid.id[window->hid.head], &i);
-  for (i = 0; device->classes[i]->type != XIValuatorClass; ++i);
-  return ((XIValuatorClassInfo*) device->classes[i])->mode == XIModeRelative;
+  /* Valuator modes are fixed per device, so each device costs one query */
+  if (!window->hid.opcode || id == window->hid.device) {
+    return window->hid.relative;
+  }
+  device = XIQueryDevice(DPY(window), id, &count);
+  window->hid.device   = id;
+  window->hid.relative = 0;
+  for (i = 0; device && i < device->num_classes; ++i) {
+    if (device->classes[i]->type == XIValuatorClass) {
+      window->hid.relative =
+        ((XIValuatorClassInfo*) device->classes[i])->mode == XIModeRelative;
+      break;
+    }
+  }
+  if (device) XIFreeDeviceInfo(device);
+  return window->hid.relative;
+}
+
+static Bool
+htIsRawEvent(Display* display, XEvent* event, XPointer data) {
+  const HTInstance* instance = (const HTInstance*) data;
+  (void) display;
+  return event->type == GenericEvent &&
+    event->xcookie.extension == instance->xi_opcode;
+}
+
+static Bool
+htCountRawEvent(Display* display, XEvent* event, XPointer data) {
+  htRawCount* const raw = (htRawCount*) data;
+  (void) display;
+  if (event->type == GenericEvent && event->xcookie.extension == raw->opcode) {
+    ++raw->count;
+  }
+  /* Nothing is dequeued, the whole queue is only counted */
+  return False;
+}
+
+static void
+htDiscardRawInput(HTWindow* window, int keep) {
+  /* Cookie data is never fetched, so dropping an event frees it */
+  XEvent event = {0};
+  htRawCount raw = {0};
+  raw.opcode = window->instance->xi_opcode;
+  XCheckIfEvent(DPY(window), &event, htCountRawEvent, (XPointer) &raw);
+  /* Queue is shared with other events, which are never dropped */
+  while (raw.count > keep && XCheckIfEvent(
+      DPY(window), &event, htIsRawEvent, (XPointer) window->instance)) {
+    --raw.count;
+  }
+}
+
+static HTWindow*
+htGetInputOwner(HTInstance* instance) {
+  /* Raw input is shared by the connection, it belongs to the focused window
+   * with an input manager and is stale while there is none */
+  HTWindow* window = NULL;
+  LOCK();
+  for (window = instance->windows; window; window = window->next) {
+    if (window->info.focus && window->hid.opcode) break;
+  }
+  UNLOCK();
+  return window;
 }
 
 static int
@@ -190,16 +506,14 @@ htPollRawInput(HTWindow* window) {
   XEvent event = {0};
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
-  ASSERT(xi_dpy, func, HT_ERROR_WINDOW_SERVER);
-  /* Dequeue raw input events */
-  while (XPending(xi_dpy)) {
+  ASSERT(window->hid.opcode, func, HT_ERROR_UNINITIALIZED_INPUT_MANAGER);
+  /* Only the newest events of a long backlog are worth reading */
+  htDiscardRawInput(window, HT_INPUT_BACKLOG);
+  /* Dequeue raw input events, leaving the others to the drain loop */
+  while (XCheckIfEvent(
+      DPY(window), &event, htIsRawEvent, (XPointer) window->instance)) {
     XIRawEvent* raw = NULL;
-    XNextEvent(xi_dpy, &event);
-    if (event.xcookie.type != GenericEvent ||
-        event.xcookie.extension != window->hid.opcode ||
-        !XGetEventData(xi_dpy, &event.xcookie)) {
-      continue;
-    }
+    if (!XGetEventData(DPY(window), &event.xcookie)) continue;
     raw = (XIRawEvent*) event.xcookie.data;
     window->hid.id[window->hid.tail] = raw->deviceid;
     /* Store previous states in tail since not all states have new values */
@@ -212,29 +526,344 @@ htPollRawInput(HTWindow* window) {
       case XI_RawMotion:        htReadMouseXY(window, raw);     break;
       default: break;
     }
-    XFreeEventData(dpy, &event.xcookie);
+    XFreeEventData(DPY(window), &event.xcookie);
   }
   return HT_ERROR_NONE;
 }
 
+static unsigned
+htGetRefreshRate(const XRRModeInfo* mode) {
+  /* Double scan draws every line twice, interlacing shows half a frame */
+  double lines = mode->vTotal;
+  if (mode->modeFlags & RR_DoubleScan) lines *= 2.0;
+  if (mode->modeFlags & RR_Interlace) lines *= 0.5;
+  if (!mode->hTotal || !mode->vTotal) return 0;
+  return (unsigned) (mode->dotClock * 1000.0 / (mode->hTotal * lines) + 0.5);
+}
+
 static void
-htShouldCloseDisplay() {
-  Window root = DefaultRootWindow(dpy);
-  Window parent = 0;
-  Window* children = 0;
+htUpdateMonitors(HTInstance* instance) {
+  /* Round trips are made without ht_lock, which only guards the swap */
+  Display* const dpy = instance->dpy;
+  const Window root = DefaultRootWindow(dpy);
+  XRRScreenResources* resources = XRRGetScreenResourcesCurrent(dpy, root);
+  const RROutput primary = XRRGetOutputPrimary(dpy, root);
+  HTMonitor list[HT_MAX_MONITORS];
   unsigned count = 0;
-  if (XQueryTree(dpy, root, &root, &parent, &children, &count) && count < 3) {
-    /* Close display connection for client windows */
-    XFlush(dpy);
-    XCloseDisplay(dpy);
-    dpy = NULL;
+  int i = 0;
+  int j = 0;
+  for (i = 0; resources && i < resources->ncrtc; ++i) {
+    HTMonitor* const monitor = &list[count];
+    XRRCrtcInfo* crtc = NULL;
+    if (count == HT_MAX_MONITORS) break;
+    crtc = XRRGetCrtcInfo(dpy, resources, resources->crtcs[i]);
+    /* Disabled CRTCs drive no monitor */
+    if (crtc && crtc->mode != None) {
+      monitor->x       = crtc->x;
+      monitor->y       = crtc->y;
+      monitor->width   = crtc->width;
+      monitor->height  = crtc->height;
+      monitor->refresh = 0;
+      monitor->primary = 0;
+      for (j = 0; j < resources->nmode; ++j) {
+        if (resources->modes[j].id == crtc->mode) {
+          monitor->refresh = htGetRefreshRate(&resources->modes[j]);
+        }
+      }
+      for (j = 0; j < crtc->noutput; ++j) {
+        if (crtc->outputs[j] == primary) monitor->primary = 1;
+      }
+      ++count;
+    }
+    if (crtc) XRRFreeCrtcInfo(crtc);
   }
+  if (resources) XRRFreeScreenResources(resources);
+  LOCK();
+  memcpy(instance->monitor, list, count * sizeof (HTMonitor));
+  instance->monitors = count;
+  UNLOCK();
+}
+
+static HTInstance*
+htOpenInstance(const char* name) {
+  /* Caller holds ht_lock */
+  HTInstance* instance = calloc(1, sizeof (HTInstance));
+  if (!instance) return NULL;
+  if (name) {
+    instance->name = malloc(strlen(name) + 1);
+    if (!instance->name) {
+      free(instance);
+      return NULL;
+    }
+    strcpy(instance->name, name);
+  }
+  /* Open connection to X server */
+  instance->dpy = XOpenDisplay(instance->name);
+  if (instance->dpy) {
+    char  cm[32];
+    char* name[5];
+    Atom  atom[5];
+    sprintf(cm, "_NET_WM_CM_S%d", DefaultScreen(instance->dpy));
+    name[0] = "WM_DELETE_WINDOW";
+    name[1] = "_NET_WM_STATE";
+    name[2] = "_NET_WM_STATE_FULLSCREEN";
+    name[3] = "_NET_WM_BYPASS_COMPOSITOR";
+    name[4] = cm;
+    /* All atoms are interned with a single round trip */
+    XInternAtoms(instance->dpy, name, 5, False, atom);
+    instance->wm_delete_window = atom[0];
+    instance->wm_state         = atom[1];
+    instance->wm_fullscreen    = atom[2];
+    instance->wm_bypass        = atom[3];
+    instance->wm_cm            = atom[4];
+  }
+  return instance;
+}
+
+static void
+htProbeFramebuffer(HTInstance* instance) {
+  /* Extensions are queried on first use, sparing others the round trips */
+  int event = 0;
+  int error = 0;
+  LOCK();
+  if (!(instance->probed & HT_PROBE_FRAMEBUFFER)) {
+    if (XShmQueryExtension(instance->dpy)) {
+      instance->shm_completion =
+        XShmGetEventBase(instance->dpy) + ShmCompletion;
+    }
+    if (!XPresentQueryExtension(
+          instance->dpy, &instance->present_opcode, &event, &error)) {
+      instance->present_opcode = 0;
+    }
+    instance->probed |= HT_PROBE_FRAMEBUFFER;
+  }
+  UNLOCK();
+}
+
+static void
+htValidateMonitors(HTInstance* instance) {
+  /* Caller does not hold ht_lock, so readers keep the old list meanwhile */
+  int error = 0;
+  unsigned stale = 0;
+  LOCK();
+  if (!(instance->probed & HT_PROBE_RANDR)) {
+    /* Monitor list is kept current through notifications on the root */
+    if (XRRQueryExtension(instance->dpy, &instance->rr_event, &error)) {
+      XRRSelectInput(
+        instance->dpy,
+        DefaultRootWindow(instance->dpy),
+        RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask);
+      instance->stale = 1;
+    } else {
+      instance->rr_event = 0;
+    }
+    instance->probed |= HT_PROBE_RANDR;
+  }
+  /* Notifications only mark the list, it is rebuilt when next read */
+  stale = instance->stale;
+  instance->stale = 0;
+  UNLOCK();
+  if (stale) htUpdateMonitors(instance);
+}
+
+static HTInstance*
+htRetainInstance(HTInstance* instance, unsigned count) {
+  /* Windows created without an instance share the default one */
+  LOCK();
+  if (!instance) {
+    if (!ht_instance) ht_instance = htOpenInstance(NULL);
+    instance = ht_instance;
+  }
+  if (instance) instance->refs += count;
+  UNLOCK();
+  return instance;
+}
+
+static void
+htReleaseInstance(HTInstance* instance, unsigned count) {
+  LOCK();
+  instance->refs -= count;
+  if (instance->refs) {
+    UNLOCK();
+    return;
+  }
+  /* Last reference is gone, so no window uses the connections anymore */
+#ifdef HT_USE_EGL
+  if (instance->egl_dpy) eglTerminate(instance->egl_dpy);
+#endif
+  if (instance->blank) XFreeCursor(instance->dpy, instance->blank);
+  if (instance->dpy) XCloseDisplay(instance->dpy);
+  if (instance == ht_instance) ht_instance = NULL;
+  UNLOCK();
+  free(instance->snapshot);
+  free(instance->snapshot_win);
+  free(instance->snapshot_fb);
+  free(instance->name);
+  free(instance);
+}
+
+static void
+htFlush(HTInstance* instance, HTFlushPolicy point) {
+  /* Polling flushes by itself, since Xlib writes before it blocks to read */
+  LOCK();
+  if (!instance->update && instance->flush <= (unsigned) point) {
+    XFlush(instance->dpy);
+  }
+  UNLOCK();
+}
+
+static void
+htRegisterWindow(HTWindow* window, HTInstance* instance) {
+  LOCK();
+  window->instance = instance;
+  window->next = instance->windows;
+  instance->windows = window;
+  UNLOCK();
+}
+
+static void
+htUnregisterWindow(HTWindow* window) {
+  HTWindow** link = NULL;
+  LOCK();
+  for (link = &window->instance->windows; *link; link = &(*link)->next) {
+    if (*link == window) {
+      *link = window->next;
+      break;
+    }
+  }
+  UNLOCK();
 }
 
 static int
-htCreateGLPixelFormat(HTWindow* window, GLXFBConfig** fbc) {
+htInitGLDisplay(HTInstance* instance) {
+#ifdef HT_USE_EGL
+  LOAD_EGL(PFNEGLGETPLATFORMDISPLAYEXTPROC, eglGetPlatformDisplayEXT);
+  Display* const dpy = instance->dpy;
+  int result = 1;
+  LOCK();
+  if (instance->egl_dpy) {
+    UNLOCK();
+    return result;
+  }
+  /* Windows without an X server render through the surfaceless platform */
+  if (eglGetPlatformDisplayEXT && dpy) {
+    instance->egl_dpy =
+      eglGetPlatformDisplayEXT(EGL_PLATFORM_X11_KHR, dpy, NULL);
+  } else if (eglGetPlatformDisplayEXT) {
+    instance->egl_dpy = eglGetPlatformDisplayEXT(
+      EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  } else {
+    instance->egl_dpy =
+      eglGetDisplay(dpy ? (EGLNativeDisplayType) dpy : NULL);
+  }
+  if (!(instance->egl_dpy && eglInitialize(instance->egl_dpy, NULL, NULL))) {
+    instance->egl_dpy = EGL_NO_DISPLAY;
+    result = 0;
+  } else {
+    const char* ext = eglQueryString(instance->egl_dpy, EGL_EXTENSIONS);
+    /* KHR and EXT variants share the same signature */
+    if (ext && strstr(ext, "EGL_KHR_swap_buffers_with_damage")) {
+      instance->eglSwapBuffersWithDamage =
+        (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+        eglGetProcAddress("eglSwapBuffersWithDamageKHR");
+    } else if (ext && strstr(ext, "EGL_EXT_swap_buffers_with_damage")) {
+      instance->eglSwapBuffersWithDamage =
+        (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)
+        eglGetProcAddress("eglSwapBuffersWithDamageEXT");
+    }
+  }
+  UNLOCK();
+  /* Bound API is per-thread state */
+  return result && BIND_API();
+#else
+  LOAD_GLX(PFNGLXCOPYSUBBUFFERMESAPROC, glXCopySubBufferMESA);
+  const char* ext = NULL;
+  if (!instance->dpy) return 0;
+  ext = glXQueryExtensionsString(instance->dpy, DefaultScreen(instance->dpy));
+  if (ext && strstr(ext, "GLX_MESA_copy_sub_buffer")) {
+    LOCK();
+    instance->glXCopySubBufferMESA = glXCopySubBufferMESA;
+    UNLOCK();
+  }
+  return 1;
+#endif
+}
+
+static unsigned
+htGetGLFootprint(const int* attrib) {
+  /* Estimate bits per pixel of every buffer allocated for a configuration */
+  unsigned i = 1; /* Index of first decoded value */
+  const unsigned color =
+    attrib[i + 0] + attrib[i + 2] + attrib[i + 4] + attrib[i + 6];
+  const unsigned depth = attrib[i + 8] + attrib[i + 10];
+  const unsigned accum =
+    attrib[i + 12] + attrib[i + 14] + attrib[i + 16] + attrib[i + 18];
+  const unsigned samples = attrib[i + 22] ? attrib[i + 24] : 0;
+  const unsigned views = attrib[i + 30] ? 2 : 1;
+  unsigned bits = color * (attrib[i + 26] ? 2 : 1) + attrib[i + 20] * color;
+  /* Multisampled configurations keep color and depth per sample */
+  bits += samples ? samples * (color + depth) : depth;
+  return (bits + accum) * views;
+}
+
+static void
+htReadGLConfig(HTWindow* window, const int* attrib) {
+  /* Overwrite user values with pixel format attributes obtained */
+  unsigned i = 1; /* Index of first decoded value */
+  window->gl.red            = attrib[i +  0];
+  window->gl.green          = attrib[i +  2];
+  window->gl.blue           = attrib[i +  4];
+  window->gl.alpha          = attrib[i +  6];
+  window->gl.depth          = attrib[i +  8];
+  window->gl.stencil        = attrib[i + 10];
+  window->gl.accum          =
+    attrib[i + 12] + attrib[i + 14] + attrib[i + 16] + attrib[i + 18];
+  window->gl.aux_buffers    = attrib[i + 20];
+  window->gl.sample_buffers = attrib[i + 22];
+  window->gl.samples        = attrib[i + 24];
+  window->gl.double_buffer  = attrib[i + 26];
+  window->gl.accelerated    = attrib[i + 28] == PF_CAVEAT_NONE;
+  window->gl.stereo         = attrib[i + 30];
+  window->gl.pixel_type     = (attrib[i + 32] & PF_RGBA_BIT) != 0;
+  window->gl.footprint      = htGetGLFootprint(attrib);
+}
+
+static int
+htGetGLMemory(HTWindow* window) {
+  /* Framebuffer memory estimate in KiB for the current content area */
+  const unsigned long bits =
+    (unsigned long) window->gl.footprint * window->info.width;
+  return (int) ((bits * window->info.height) >> 13);
+}
+
+static int
+htCreateGLPixelFormat(HTWindow* window, htGLConfig* fbc, int* attrib) {
   const char* func = "htCreateGLPixelFormat";
-  const int caveat[] = {GLX_DONT_CARE, GLX_NONE};
+  HTInstance* const instance = window->instance;
+  const int caveat[] = {PF_CAVEAT_ANY, PF_CAVEAT_NONE};
+#ifdef HT_USE_EGL
+  /* Attributes EGL lacks have no name and keep their requested value */
+  int pfa[] = {
+    EGL_RED_SIZE,         -1,
+    EGL_GREEN_SIZE,       -1,
+    EGL_BLUE_SIZE,        -1,
+    EGL_ALPHA_SIZE,       -1,
+    EGL_DEPTH_SIZE,       -1,
+    EGL_STENCIL_SIZE,     -1,
+    0,                     0, /* Accumulation buffers are unsupported   */
+    0,                     0,
+    0,                     0,
+    0,                     0,
+    0,                     0, /* Auxilary buffers are unsupported       */
+    EGL_SAMPLE_BUFFERS,   -1,
+    EGL_SAMPLES,          -1,
+    0,                    -1, /* Double buffering is a surface property */
+    EGL_CONFIG_CAVEAT,    -1,
+    0,                     0, /* Stereoscopic buffers are unsupported   */
+    EGL_RENDERABLE_TYPE,  EGL_OPENGL_BIT,
+    EGL_SURFACE_TYPE,     -1,
+    EGL_NONE};
+#else
   int pfa[] = {
     GLX_RED_SIZE,         -1,
     GLX_GREEN_SIZE,       -1,
@@ -252,233 +881,1882 @@ htCreateGLPixelFormat(HTWindow* window, GLXFBConfig** fbc) {
     GLX_DOUBLEBUFFER,     -1,
     GLX_CONFIG_CAVEAT,    -1,
     GLX_STEREO,           -1,
+    GLX_RENDER_TYPE,      GLX_RGBA_BIT,
+    GLX_DRAWABLE_TYPE,    -1,
     None};
+#endif
   /* Overwrite default pixel format attribtues with user values */
-  int count = 0;
   unsigned i = 1; /* Index of first rewritable element */
+  unsigned j = 0;
   pfa[i +  0] = window->gl.red;
   pfa[i +  2] = window->gl.green;
   pfa[i +  4] = window->gl.blue;
   pfa[i +  6] = window->gl.alpha;
   pfa[i +  8] = window->gl.depth;
   pfa[i + 10] = window->gl.stencil;
+#ifndef HT_USE_EGL
   pfa[i + 12] = window->gl.accum >> 2;
   pfa[i + 14] = window->gl.accum >> 2;
   pfa[i + 16] = window->gl.accum >> 2;
   pfa[i + 18] = window->gl.accum >> 2;
   pfa[i + 20] = window->gl.aux_buffers;
+  pfa[i + 30] = window->gl.stereo;
+#endif
   pfa[i + 22] = window->gl.sample_buffers;
   pfa[i + 24] = window->gl.samples;
   pfa[i + 26] = window->gl.double_buffer;
   pfa[i + 28] = caveat[window->gl.accelerated];
-  pfa[i + 30] = window->gl.stereo;
-  *fbc = glXChooseFBConfig(dpy, DefaultScreen(dpy), pfa, &count);
-  if (!*fbc) return HANDLE_ERROR(func, HT_ERROR_GL_PIXEL_FORMAT_NONE);
+  pfa[i + 34] = window->win ? PF_WINDOW_BIT : PF_PBUFFER_BIT;
+  /* Reuse a configuration chosen earlier for the same pixel format */
+  LOCK();
+  for (j = 0; j < HT_GL_CONFIG_CACHE_SIZE; ++j) {
+    if (!memcmp(instance->gl_config[j].pfa, pfa, sizeof (pfa))) break;
+  }
+  if (j == HT_GL_CONFIG_CACHE_SIZE) {
+    int count = 0;
+    int k = 0;
+    int best = -1;
+    int visual = 0;
+    int attrib_list[HT_GL_PFA_SIZE] = {0};
+    unsigned footprint = ~0u;
+    unsigned accelerated = 0;
+    /* Windows are created with the default visual, pbuffers have none */
+    const VisualID wanted = window->win ? XVisualIDFromVisual(
+      DefaultVisual(DPY(window), DefaultScreen(DPY(window)))) : 0;
+#ifdef HT_USE_EGL
+    EGLConfig* list = NULL;
+    /* Drop the attributes EGL lacks from the list passed to EGL */
+    for (i = 0, k = 0; i < HT_GL_PFA_SIZE; i += 2) {
+      if (!pfa[i]) continue;
+      attrib_list[k++] = pfa[i];
+      attrib_list[k++] = pfa[i + 1];
+    }
+    if (eglChooseConfig(instance->egl_dpy, attrib_list, NULL, 0, &count) &&
+        count) {
+      list = malloc(count * sizeof (EGLConfig));
+    }
+    if (!(list &&
+        eglChooseConfig(instance->egl_dpy, attrib_list, list, count, &count))) {
+      free(list);
+      UNLOCK();
+      return INSTANCE_ERROR(instance, func, HT_ERROR_GL_PIXEL_FORMAT_NONE);
+    }
+#else
+    GLXFBConfig* list =
+      glXChooseFBConfig(DPY(window), DefaultScreen(DPY(window)), pfa, &count);
+    if (!list) {
+      UNLOCK();
+      return INSTANCE_ERROR(instance, func, HT_ERROR_GL_PIXEL_FORMAT_NONE);
+    }
+#endif
+    /* Replace the oldest cache entry */
+    j = instance->gl_config_next;
+    /* Pick the smallest configuration meeting the request since the list is
+     * sorted towards the largest buffers, but never trade acceleration */
+    for (k = 0; k < count; ++k) {
+      unsigned size = 0;
+      unsigned fast = 0;
+      /* Other visuals fail with BadMatch once bound to the window */
+      if (wanted) {
+        GET_CONFIG_ATTRIB(GL_DPY(window), list[k], PF_VISUAL_ID, &visual);
+        if ((VisualID) visual != wanted) continue;
+      }
+      memcpy(attrib_list, pfa, sizeof (pfa));
+      for (i = 0; i < HT_GL_PFA_SIZE - 1; i += 2) {
+        if (!pfa[i]) continue;
+        GET_CONFIG_ATTRIB(GL_DPY(window), list[k], pfa[i], &attrib_list[i + 1]);
+      }
+      size = htGetGLFootprint(attrib_list);
+      fast = attrib_list[HT_GL_PFA_CAVEAT] == PF_CAVEAT_NONE;
+      if (fast > accelerated || (fast == accelerated && size < footprint)) {
+        memcpy(
+          instance->gl_config[j].attrib, attrib_list, sizeof (attrib_list));
+        footprint = size;
+        accelerated = fast;
+        best = k;
+      }
+    }
+    if (best >= 0) {
+      instance->gl_config_next = (j + 1) & (HT_GL_CONFIG_CACHE_SIZE - 1);
+      memcpy(instance->gl_config[j].pfa, pfa, sizeof (pfa));
+      instance->gl_config[j].fbc = list[best];
+    }
+#ifdef HT_USE_EGL
+    free(list);
+#else
+    XFree(list);
+#endif
+    if (best < 0) {
+      UNLOCK();
+      return INSTANCE_ERROR(instance, func, HT_ERROR_GL_PIXEL_FORMAT_NONE);
+    }
+  }
+  /* Copy out since other threads may replace the entry */
+  *fbc = instance->gl_config[j].fbc;
+  memcpy(attrib, instance->gl_config[j].attrib, sizeof (int) * HT_GL_PFA_SIZE);
+  UNLOCK();
   return HT_ERROR_NONE;
 }
 
 static void
 htSetSwapInterval(HTWindow* window) {
   /* Set swap interval for vsync */
-#ifdef GLX_EXT_swap_control
+#ifdef HT_USE_EGL
+  eglSwapInterval(GL_DPY(window), window->gl.swap_interval);
+#elif defined GLX_EXT_swap_control
   LOAD_GLX(PFNGLXSWAPINTERVALEXTPROC, glXSwapIntervalEXT);
   const int interval = window->gl.swap_interval;
-  if (glXSwapIntervalEXT) glXSwapIntervalEXT(dpy, window->win, interval);
+  if (glXSwapIntervalEXT && window->win) {
+    glXSwapIntervalEXT(DPY(window), window->win, interval);
+  }
 #elif defined GLX_MESA_swap_control
   LOAD_GLX(PFNGLXSWAPINTERVALMESAPROC, glXSwapIntervalMESA);
   if (glXSwapIntervalMESA) glXSwapIntervalMESA(window->gl.swap_interval);
 #endif
 }
 
+static htGLContext
+htCreateContext(HTWindow* window, htGLConfig fbc, htGLContext share) {
+#ifdef HT_USE_EGL
+  EGLint version[] = {
+    EGL_CONTEXT_MAJOR_VERSION_KHR, -1,
+    EGL_CONTEXT_MINOR_VERSION_KHR, -1,
+    EGL_NONE};
+  version[1] = window->gl.major;
+  version[3] = window->gl.minor;
+  return eglCreateContext(GL_DPY(window), fbc, share, version);
+#else
+  LOAD_GLX(PFNGLXCREATECONTEXTATTRIBSARBPROC, glXCreateContextAttribsARB);
+  if (glXCreateContextAttribsARB) {
+    int version[] = {
+      GLX_CONTEXT_MAJOR_VERSION_ARB, -1,
+      GLX_CONTEXT_MINOR_VERSION_ARB, -1,
+      None};
+    version[1] = window->gl.major;
+    version[3] = window->gl.minor;
+    return glXCreateContextAttribsARB(DPY(window), fbc, share, 1, version);
+  } else if (window->gl.major < 3 || share) {
+    return glXCreateNewContext(DPY(window), fbc, GLX_RGBA_TYPE, share, 1);
+  }
+  return NULL;
+#endif
+}
+
+static int
+htCatchXError(Display* display, XErrorEvent* event) {
+  (void) display;
+  ht_x_error = event->error_code;
+  return 0;
+}
+
+static htGLDrawable
+htCreatePbuffer(
+    HTWindow* window, htGLConfig fbc, unsigned width, unsigned height) {
+#ifdef HT_USE_EGL
+  EGLint pbuffer_attrib[] = {
+    EGL_WIDTH,  -1,
+    EGL_HEIGHT, -1,
+    EGL_NONE};
+#else
+  int (*handler)(Display*, XErrorEvent*) = NULL;
+  GLXPbuffer pbuffer = 0;
+  int pbuffer_attrib[] = {
+    GLX_PBUFFER_WIDTH,       -1,
+    GLX_PBUFFER_HEIGHT,      -1,
+    GLX_PRESERVED_CONTENTS,  True,
+    None};
+#endif
+  if (!width || !height) return 0;
+  pbuffer_attrib[1] = width;
+  pbuffer_attrib[3] = height;
+#ifdef HT_USE_EGL
+  return eglCreatePbufferSurface(GL_DPY(window), fbc, pbuffer_attrib);
+#else
+  /* Failures are only reported as errors, after an ID was handed out */
+  LOCK();
+  ht_x_error = 0;
+  handler = XSetErrorHandler(htCatchXError);
+  pbuffer = glXCreatePbuffer(DPY(window), fbc, pbuffer_attrib);
+  XSync(DPY(window), False);
+  XSetErrorHandler(handler);
+  if (ht_x_error) pbuffer = 0;
+  UNLOCK();
+  return pbuffer;
+#endif
+}
+
+static htGLDrawable
+htCreateGLDrawable(HTWindow* window, htGLConfig fbc) {
+  /* Offscreen windows render into a pbuffer of the content area size */
+  if (!window->win) {
+    return htCreatePbuffer(
+      window, fbc, window->info.width, window->info.height);
+  } else {
+#ifdef HT_USE_EGL
+    EGLint surface_attrib[] = {
+      EGL_RENDER_BUFFER, -1,
+      EGL_NONE};
+    surface_attrib[1] =
+      window->gl.double_buffer ? EGL_BACK_BUFFER : EGL_SINGLE_BUFFER;
+    return eglCreateWindowSurface(
+      GL_DPY(window), fbc, (EGLNativeWindowType) window->win, surface_attrib);
+#else
+    return window->win;
+#endif
+  }
+}
+
+static void
+htDestroyGLDrawable(HTWindow* window) {
+#ifndef HT_USE_EGL
+  /* GLX renders into X windows directly */
+  if (window->win) return;
+#endif
+  if (window->gl.drawable) DESTROY_PBUFFER(GL_DPY(window), window->gl.drawable);
+}
+
+static void
+htDestroySharedGLContexts(HTWindow* window) {
+  unsigned i = 0;
+  for (i = 0; i < window->pool.count; ++i) {
+    const htGLDrawable pbuffer = window->pool.pbuffer[i];
+    const htGLContext  context = window->pool.context[i];
+    if (pbuffer) DESTROY_PBUFFER(GL_DPY(window), pbuffer);
+    if (context) DESTROY_CONTEXT(GL_DPY(window), context);
+  }
+  if (window->pool.count) pthread_mutex_destroy(&window->pool.lock);
+  free(window->pool.context);
+  free(window->pool.pbuffer);
+  free(window->pool.busy);
+  window->pool.context = NULL;
+  window->pool.pbuffer = NULL;
+  window->pool.busy    = NULL;
+  window->pool.count   = 0;
+}
+
+static int
+htResizePbuffer(HTWindow* window) {
+  const char* func = "htResizePbuffer";
+  /* Pbuffers cannot be resized, so replace the drawable of the context */
+  const htGLDrawable pbuffer = window->gl.drawable;
+  const htGLDrawable resized = htCreatePbuffer(
+    window, window->gl.config, window->info.width, window->info.height);
+  const int current = GET_CURRENT_CONTEXT() == window->gl.context;
+  if (!resized) {
+    /* Window keeps the old pbuffer, and so the size it had */
+#ifdef HT_USE_EGL
+    EGLint width = 0;
+    EGLint height = 0;
+    eglQuerySurface(GL_DPY(window), pbuffer, EGL_WIDTH, &width);
+    eglQuerySurface(GL_DPY(window), pbuffer, EGL_HEIGHT, &height);
+#else
+    unsigned width = 0;
+    unsigned height = 0;
+    glXQueryDrawable(DPY(window), pbuffer, GLX_WIDTH, &width);
+    glXQueryDrawable(DPY(window), pbuffer, GLX_HEIGHT, &height);
+#endif
+    window->info.width  = width;
+    window->info.height = height;
+    return INSTANCE_ERROR(
+      window->instance, func, HT_ERROR_GL_CONTEXT_CREATION);
+  }
+  window->gl.drawable = resized;
+  if (current) {
+    MAKE_CURRENT(GL_DPY(window), window->gl.drawable, window->gl.context);
+  }
+  DESTROY_PBUFFER(GL_DPY(window), pbuffer);
+  return HT_ERROR_NONE;
+}
+
+static void
+htDestroyGLFrames(HTWindow* window) {
+  /* Caller made the window context current, deleting a bound object
+   * binding the window's own framebuffer again */
+  window->present.glDeleteFramebuffers(
+    window->present.slots, window->present.fbo);
+  window->present.glDeleteRenderbuffers(
+    window->present.slots, window->present.color);
+  if (window->present.depth[0]) {
+    window->present.glDeleteRenderbuffers(
+      window->present.slots, window->present.depth);
+  }
+}
+
+#ifndef HT_USE_EGL
+static int
+htCreateGLFrames(HTWindow* window) {
+  /* Caller made the window context current, frames take its current size */
+  const unsigned width  = window->info.width  ? window->info.width  : 1;
+  const unsigned height = window->info.height ? window->info.height : 1;
+  GLenum status = GL_FRAMEBUFFER_COMPLETE;
+  unsigned i = 0;
+  window->present.glGenFramebuffers(window->present.slots, window->present.fbo);
+  window->present.glGenRenderbuffers(
+    window->present.slots, window->present.color);
+  if (window->gl.depth || window->gl.stencil) {
+    window->present.glGenRenderbuffers(
+      window->present.slots, window->present.depth);
+  }
+  for (i = 0; i < window->present.slots; ++i) {
+    window->present.width[i]  = width;
+    window->present.height[i] = height;
+    window->present.glBindRenderbuffer(
+      GL_RENDERBUFFER, window->present.color[i]);
+    window->present.glRenderbufferStorage(
+      GL_RENDERBUFFER, GL_RGBA8, width, height);
+    window->present.glBindFramebuffer(GL_FRAMEBUFFER, window->present.fbo[i]);
+    window->present.glFramebufferRenderbuffer(
+      GL_FRAMEBUFFER,
+      GL_COLOR_ATTACHMENT0,
+      GL_RENDERBUFFER,
+      window->present.color[i]);
+    if (window->present.depth[i]) {
+      window->present.glBindRenderbuffer(
+        GL_RENDERBUFFER, window->present.depth[i]);
+      window->present.glRenderbufferStorage(
+        GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+      window->present.glFramebufferRenderbuffer(
+        GL_FRAMEBUFFER,
+        GL_DEPTH_STENCIL_ATTACHMENT,
+        GL_RENDERBUFFER,
+        window->present.depth[i]);
+    }
+    if (status == GL_FRAMEBUFFER_COMPLETE) {
+      status = window->present.glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    }
+  }
+  window->present.glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  /* Rendering goes into the frame object until it is queued */
+  window->present.glBindFramebuffer(GL_FRAMEBUFFER, window->present.fbo[0]);
+  return status == GL_FRAMEBUFFER_COMPLETE;
+}
+
+static void*
+htPresentThread(void* data) {
+  HTWindow* window = data;
+  GLsync fence = NULL;
+  GLuint read = 0;
+  unsigned slot = 0;
+  /* Drawable is shared with the render thread, the context is not */
+  MAKE_CURRENT(GL_DPY(window), window->gl.drawable, window->present.context);
+  htSetSwapInterval(window);
+  /* Framebuffer objects are not shared, the renderbuffers they hold are */
+  window->present.glGenFramebuffers(1, &read);
+  pthread_mutex_lock(&window->present.lock);
+  for (;;) {
+    while (window->present.head == window->present.tail &&
+        !window->present.quit) {
+      pthread_cond_wait(&window->present.queued, &window->present.lock);
+    }
+    if (window->present.head == window->present.tail) break;
+    slot  = window->present.head % window->present.slots;
+    fence = window->present.fence[slot];
+    pthread_mutex_unlock(&window->present.lock);
+    /* Wait for the frame to finish rendering, then wait on vblank here */
+    if (fence) {
+      window->present.glClientWaitSync(
+        fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+      window->present.glDeleteSync(fence);
+    }
+    /* Attaching again picks up storage the render thread reallocated */
+    window->present.glBindFramebuffer(GL_READ_FRAMEBUFFER, read);
+    window->present.glFramebufferRenderbuffer(
+      GL_READ_FRAMEBUFFER,
+      GL_COLOR_ATTACHMENT0,
+      GL_RENDERBUFFER,
+      window->present.color[slot]);
+    window->present.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    window->present.glBlitFramebuffer(
+      0,
+      0,
+      window->present.width[slot],
+      window->present.height[slot],
+      0,
+      0,
+      window->present.width[slot],
+      window->present.height[slot],
+      GL_COLOR_BUFFER_BIT,
+      GL_NEAREST);
+    SWAP_BUFFERS(GL_DPY(window), window->gl.drawable);
+    /* Frame object is handed back only once the copy has been read */
+    glFinish();
+    pthread_mutex_lock(&window->present.lock);
+    ++window->present.head;
+    pthread_cond_signal(&window->present.done);
+  }
+  pthread_mutex_unlock(&window->present.lock);
+  window->present.glDeleteFramebuffers(1, &read);
+  MAKE_CURRENT(GL_DPY(window), 0, 0);
+  return NULL;
+}
+#endif
+
+static void
+htQueuePresent(HTWindow* window) {
+  const unsigned width  = window->info.width  ? window->info.width  : 1;
+  const unsigned height = window->info.height ? window->info.height : 1;
+  GLsync fence = NULL;
+  unsigned slot = 0;
+  /* Without sync objects the frame must be complete before it is queued */
+  if (window->present.glFenceSync) {
+    fence = window->present.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  if (fence) glFlush();
+  else glFinish();
+  pthread_mutex_lock(&window->present.lock);
+  window->present.fence[window->present.tail % window->present.slots] = fence;
+  ++window->present.tail;
+  pthread_cond_signal(&window->present.queued);
+  /* Next frame object is free once the frame that last used it was shown,
+   * so block only once the configured number of frames is in flight */
+  while (window->present.tail - window->present.head >
+      window->present.frames) {
+    pthread_cond_wait(&window->present.done, &window->present.lock);
+  }
+  slot = window->present.tail % window->present.slots;
+  pthread_mutex_unlock(&window->present.lock);
+  /* Frame objects follow the window size, each one when it is reused */
+  if (window->present.width[slot]  != width ||
+      window->present.height[slot] != height) {
+    window->present.width[slot]  = width;
+    window->present.height[slot] = height;
+    window->present.glBindRenderbuffer(
+      GL_RENDERBUFFER, window->present.color[slot]);
+    window->present.glRenderbufferStorage(
+      GL_RENDERBUFFER,
+      GL_RGBA8,
+      window->present.width[slot],
+      window->present.height[slot]);
+    if (window->present.depth[slot]) {
+      window->present.glBindRenderbuffer(
+        GL_RENDERBUFFER, window->present.depth[slot]);
+      window->present.glRenderbufferStorage(
+        GL_RENDERBUFFER,
+        GL_DEPTH24_STENCIL8,
+        window->present.width[slot],
+        window->present.height[slot]);
+    }
+    window->present.glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  }
+  window->present.glBindFramebuffer(GL_FRAMEBUFFER, window->present.fbo[slot]);
+}
+
+static void
+htStopPresentThread(HTWindow* window) {
+  const htGLContext prev = GET_CURRENT_CONTEXT();
+  const htGLDrawable prev_drawable = GET_CURRENT_DRAWABLE();
+  if (!window->present.context) return;
+  pthread_mutex_lock(&window->present.lock);
+  window->present.quit = 1;
+  pthread_cond_signal(&window->present.queued);
+  pthread_mutex_unlock(&window->present.lock);
+  pthread_join(window->present.thread, NULL);
+  DESTROY_CONTEXT(GL_DPY(window), window->present.context);
+  /* Frame objects belong to the window context, so it must be current */
+  if (prev != window->gl.context) {
+    MAKE_CURRENT(GL_DPY(window), window->gl.drawable, window->gl.context);
+  }
+  htDestroyGLFrames(window);
+  if (prev != window->gl.context) {
+    MAKE_CURRENT(GL_DPY(window), prev_drawable, prev);
+  }
+  pthread_cond_destroy(&window->present.queued);
+  pthread_cond_destroy(&window->present.done);
+  pthread_mutex_destroy(&window->present.lock);
+  memset(&window->present, 0, sizeof (window->present));
+}
+
+static void
+htConvertRGBA8(unsigned char* dst, const unsigned char* src, unsigned count) {
+  unsigned i = 0;
+  for (i = 0; i < count << 2; i += 4) {
+    dst[i + 0] = src[i + 2];
+    dst[i + 1] = src[i + 1];
+    dst[i + 2] = src[i + 0];
+    dst[i + 3] = src[i + 3];
+  }
+}
+
+static void
+htConvertRGB565(unsigned char* dst, const unsigned char* src, unsigned count) {
+  unsigned i = 0;
+  for (i = 0; i < count; ++i) {
+    const unsigned p = src[(i << 1) + 0] | src[(i << 1) + 1] << 8;
+    const unsigned r = p >> 11 & 0x1F;
+    const unsigned g = p >> 5 & 0x3F;
+    const unsigned b = p & 0x1F;
+    /* Replicate the high bits so full intensity maps to 0xFF */
+    dst[(i << 2) + 0] = b << 3 | b >> 2;
+    dst[(i << 2) + 1] = g << 2 | g >> 4;
+    dst[(i << 2) + 2] = r << 3 | r >> 2;
+    dst[(i << 2) + 3] = 0xFF;
+  }
+}
+
+#ifdef HT_SIMD_X86
+TARGET("sse2") static void
+htConvertRGBA8SSE2(
+    unsigned char* dst, const unsigned char* src, unsigned count) {
+  const __m128i ga = _mm_set1_epi32(0xFF00FF00);
+  const __m128i rb = _mm_set1_epi32(0x00FF00FF);
+  unsigned i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i p = _mm_loadu_si128((const __m128i*) (src + (i << 2)));
+    const __m128i q = _mm_and_si128(p, rb);
+    /* Rotating each pixel by 16 bits swaps the red and blue bytes */
+    const __m128i swap = _mm_or_si128(
+      _mm_slli_epi32(q, 16), _mm_srli_epi32(q, 16));
+    _mm_storeu_si128(
+      (__m128i*) (dst + (i << 2)), _mm_or_si128(swap, _mm_and_si128(p, ga)));
+  }
+  htConvertRGBA8(dst + (i << 2), src + (i << 2), count - i);
+}
+
+TARGET("avx2") static void
+htConvertRGBA8AVX2(
+    unsigned char* dst, const unsigned char* src, unsigned count) {
+  const __m256i shuffle = _mm256_setr_epi8(
+    2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+    2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+  unsigned i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i p = _mm256_loadu_si256((const __m256i*) (src + (i << 2)));
+    _mm256_storeu_si256(
+      (__m256i*) (dst + (i << 2)), _mm256_shuffle_epi8(p, shuffle));
+  }
+  htConvertRGBA8(dst + (i << 2), src + (i << 2), count - i);
+}
+
+TARGET("sse2") static void
+htConvertRGB565SSE2(
+    unsigned char* dst, const unsigned char* src, unsigned count) {
+  const __m128i m2 = _mm_set1_epi16(0x03);
+  const __m128i m3 = _mm_set1_epi16(0x07);
+  const __m128i m5 = _mm_set1_epi16(0xF8);
+  const __m128i m6 = _mm_set1_epi16(0xFC);
+  const __m128i x  = _mm_set1_epi16((short) 0xFF00);
+  unsigned i = 0;
+  for (; i + 8 <= count; i += 8) {
+    /* Widen channels in 16-bit lanes, then interleave into 32-bit pixels */
+    const __m128i p = _mm_loadu_si128((const __m128i*) (src + (i << 1)));
+    const __m128i r = _mm_or_si128(
+      _mm_and_si128(_mm_srli_epi16(p, 8), m5), _mm_srli_epi16(p, 13));
+    const __m128i g = _mm_or_si128(
+      _mm_and_si128(_mm_srli_epi16(p, 3), m6),
+      _mm_and_si128(_mm_srli_epi16(p, 9), m2));
+    const __m128i b = _mm_or_si128(
+      _mm_and_si128(_mm_slli_epi16(p, 3), m5),
+      _mm_and_si128(_mm_srli_epi16(p, 2), m3));
+    const __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+    const __m128i rx = _mm_or_si128(r, x);
+    _mm_storeu_si128(
+      (__m128i*) (dst + (i << 2)), _mm_unpacklo_epi16(bg, rx));
+    _mm_storeu_si128(
+      (__m128i*) (dst + (i << 2) + 16), _mm_unpackhi_epi16(bg, rx));
+  }
+  htConvertRGB565(dst + (i << 2), src + (i << 1), count - i);
+}
+
+TARGET("avx2") static void
+htConvertRGB565AVX2(
+    unsigned char* dst, const unsigned char* src, unsigned count) {
+  const __m256i m2 = _mm256_set1_epi16(0x03);
+  const __m256i m3 = _mm256_set1_epi16(0x07);
+  const __m256i m5 = _mm256_set1_epi16(0xF8);
+  const __m256i m6 = _mm256_set1_epi16(0xFC);
+  const __m256i x  = _mm256_set1_epi16((short) 0xFF00);
+  unsigned i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m256i p = _mm256_loadu_si256((const __m256i*) (src + (i << 1)));
+    const __m256i r = _mm256_or_si256(
+      _mm256_and_si256(_mm256_srli_epi16(p, 8), m5), _mm256_srli_epi16(p, 13));
+    const __m256i g = _mm256_or_si256(
+      _mm256_and_si256(_mm256_srli_epi16(p, 3), m6),
+      _mm256_and_si256(_mm256_srli_epi16(p, 9), m2));
+    const __m256i b = _mm256_or_si256(
+      _mm256_and_si256(_mm256_slli_epi16(p, 3), m5),
+      _mm256_and_si256(_mm256_srli_epi16(p, 2), m3));
+    const __m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+    const __m256i rx = _mm256_or_si256(r, x);
+    /* Unpacking stays within 128-bit lanes, so restore the pixel order */
+    const __m256i lo = _mm256_unpacklo_epi16(bg, rx);
+    const __m256i hi = _mm256_unpackhi_epi16(bg, rx);
+    _mm256_storeu_si256(
+      (__m256i*) (dst + (i << 2)), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(
+      (__m256i*) (dst + (i << 2) + 32),
+      _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  htConvertRGB565(dst + (i << 2), src + (i << 1), count - i);
+}
+#endif
+
+static htConvertRow
+htSelectConversion(unsigned format) {
+  /* Pick the widest kernel the CPU supports */
+#ifdef HT_SIMD_X86
+  __builtin_cpu_init();
+#endif
+  switch (format) {
+    case HT_PIXEL_FORMAT_RGBA8:
+#ifdef HT_SIMD_X86
+      if (__builtin_cpu_supports("avx2")) return htConvertRGBA8AVX2;
+      if (__builtin_cpu_supports("sse2")) return htConvertRGBA8SSE2;
+#endif
+      return htConvertRGBA8;
+    case HT_PIXEL_FORMAT_RGB565:
+#ifdef HT_SIMD_X86
+      if (__builtin_cpu_supports("avx2")) return htConvertRGB565AVX2;
+      if (__builtin_cpu_supports("sse2")) return htConvertRGB565SSE2;
+#endif
+      return htConvertRGB565;
+    default: return NULL;
+  }
+}
+
+static XImage*
+htCreateShmImage(
+    HTWindow* window, Visual* visual, unsigned depth, XShmSegmentInfo* shm) {
+  Display* const dpy = DPY(window);
+  int (*handler)(Display*, XErrorEvent*) = NULL;
+  int error = 0;
+  XImage* image = XShmCreateImage(
+    dpy,
+    visual,
+    depth,
+    ZPixmap,
+    NULL,
+    shm,
+    window->info.width,
+    window->info.height);
+  if (!image) return NULL;
+  shm->shmid = shmget(
+    IPC_PRIVATE,
+    (size_t) image->bytes_per_line * image->height,
+    IPC_CREAT | 0600);
+  shm->shmaddr = shm->shmid < 0 ? NULL : shmat(shm->shmid, NULL, 0);
+  if (shm->shmaddr == (char*) -1) shm->shmaddr = NULL;
+  shm->readOnly = False;
+  image->data = shm->shmaddr;
+  /* Attaching fails on remote displays, which is only reported as error */
+  error = !shm->shmaddr;
+  if (!error) {
+    LOCK();
+    ht_x_error = 0;
+    handler = XSetErrorHandler(htCatchXError);
+    XShmAttach(dpy, shm);
+    XSync(dpy, False);
+    XSetErrorHandler(handler);
+    error = ht_x_error;
+    UNLOCK();
+  }
+  /* Segment is freed once both the client and server detached */
+  if (shm->shmid >= 0) shmctl(shm->shmid, IPC_RMID, NULL);
+  if (error) {
+    if (shm->shmaddr) shmdt(shm->shmaddr);
+    shm->shmaddr = NULL;
+    image->data = NULL;
+    XDestroyImage(image);
+    return NULL;
+  }
+  return image;
+}
+
+static XImage*
+htCreateFramebufferImage(
+    HTWindow* window, Visual* visual, unsigned depth, XShmSegmentInfo* shm) {
+  XImage* image = NULL;
+  /* Shared memory avoids copying every frame through the socket */
+  if (window->instance->shm_completion) {
+    image = htCreateShmImage(window, visual, depth, shm);
+    if (image) return image;
+  }
+  image = XCreateImage(
+    DPY(window),
+    visual,
+    depth,
+    ZPixmap,
+    0,
+    NULL,
+    window->info.width,
+    window->info.height,
+    32,
+    0);
+  if (image) {
+    image->data = malloc((size_t) image->bytes_per_line * image->height);
+  }
+  if (image && !image->data) {
+    XDestroyImage(image);
+    return NULL;
+  }
+  return image;
+}
+
+static void
+htDestroyFramebufferImage(HTWindow* window) {
+  const unsigned format  = window->fb.format;
+  const unsigned buffers = window->fb.buffers;
+  unsigned i = 0;
+  /* Other threads handling Present events walk the buffers under ht_lock */
+  LOCK();
+  if (!window->fb.count) {
+    UNLOCK();
+    return;
+  }
+  if (window->fb.eid) {
+    XPresentFreeInput(DPY(window), window->win, window->fb.eid);
+  }
+  for (i = 0; i < window->fb.count; ++i) {
+    XShmSegmentInfo* const shm = &window->fb.buffer[i].shm;
+    if (window->fb.buffer[i].pixmap) {
+      XFreePixmap(DPY(window), window->fb.buffer[i].pixmap);
+    }
+    if (!window->fb.buffer[i].image) continue;
+    if (shm->shmaddr) {
+      XShmDetach(DPY(window), shm);
+      XSync(DPY(window), False);
+      shmdt(shm->shmaddr);
+      /* Shared memory was not allocated by Xlib */
+      window->fb.buffer[i].image->data = NULL;
+    }
+    XDestroyImage(window->fb.buffer[i].image);
+  }
+  if (window->fb.gc) XFreeGC(DPY(window), window->fb.gc);
+  free(window->fb.pixels);
+  /* Requested layout applies to the next framebuffer too */
+  memset(&window->fb, 0, sizeof (window->fb));
+  window->fb.format  = format;
+  window->fb.buffers = buffers;
+  UNLOCK();
+}
+
+static unsigned
+htUsePresent(HTWindow* window) {
+  unsigned i = 0;
+  /* Flipping between buffers only pays off with at least two of them */
+  if (!window->instance->present_opcode || window->fb.count < 2) return 0;
+  if (XShmPixmapFormat(DPY(window)) != ZPixmap) return 0;
+  for (i = 0; i < window->fb.count; ++i) {
+    if (!window->fb.buffer[i].shm.shmaddr) return 0;
+  }
+  return 1;
+}
+
+static void
+htCreateFramebufferPixmaps(HTWindow* window, unsigned depth) {
+  Display* const dpy = DPY(window);
+  int (*handler)(Display*, XErrorEvent*) = NULL;
+  int error = 0;
+  unsigned i = 0;
+  /* Shared pixmaps may be refused by the server, which is only reported as
+   * an error, so images are then put without the Present extension */
+  LOCK();
+  ht_x_error = 0;
+  handler = XSetErrorHandler(htCatchXError);
+  for (i = 0; i < window->fb.count; ++i) {
+    window->fb.buffer[i].pixmap = XShmCreatePixmap(
+      dpy,
+      window->win,
+      window->fb.buffer[i].shm.shmaddr,
+      &window->fb.buffer[i].shm,
+      window->info.width,
+      window->info.height,
+      depth);
+    if (!window->fb.buffer[i].pixmap) error = 1;
+  }
+  XSync(dpy, False);
+  if (error || ht_x_error) {
+    for (i = 0; i < window->fb.count; ++i) {
+      if (window->fb.buffer[i].pixmap) {
+        XFreePixmap(dpy, window->fb.buffer[i].pixmap);
+      }
+      window->fb.buffer[i].pixmap = 0;
+    }
+    XSync(dpy, False);
+  }
+  XSetErrorHandler(handler);
+  error = error || ht_x_error;
+  UNLOCK();
+  if (error) return;
+  window->fb.eid = XPresentSelectInput(
+    dpy, window->win, PresentCompleteNotifyMask | PresentIdleNotifyMask);
+}
+
+static int
+htAllocateFramebuffer(HTWindow* window, const char* func) {
+  Display* const dpy = DPY(window);
+  Visual* const visual = DefaultVisual(dpy, DefaultScreen(dpy));
+  const unsigned depth = DefaultDepth(dpy, DefaultScreen(dpy));
+  XImage* image = NULL;
+  unsigned i = 0;
+  window->fb.gc = XCreateGC(dpy, window->win, 0, NULL);
+  for (i = 0; i < window->fb.buffers; ++i) {
+    image = htCreateFramebufferImage(
+      window, visual, depth, &window->fb.buffer[i].shm);
+    window->fb.buffer[i].image = image;
+    window->fb.count = i + 1;
+    /* Pixels are exposed as 32-bit words in the visual's channel order */
+    if (!image || image->bits_per_pixel != 32) {
+      htDestroyFramebufferImage(window);
+      return INSTANCE_ERROR(window->instance, func, HT_ERROR_WINDOW_SERVER);
+    }
+  }
+  /* Start on the last buffer so the first acquire picks the first one */
+  window->fb.current = window->fb.count - 1;
+  if (htUsePresent(window)) htCreateFramebufferPixmaps(window, depth);
+  if (window->fb.format == HT_PIXEL_FORMAT_NATIVE) return HT_ERROR_NONE;
+  /* Other formats are converted into the common BGRX layout on present */
+  if (!(image->byte_order == LSBFirst &&
+      visual->red_mask   == 0xFF0000 &&
+      visual->green_mask == 0x00FF00 &&
+      visual->blue_mask  == 0x0000FF)) {
+    htDestroyFramebufferImage(window);
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_WINDOW_SERVER);
+  }
+  window->fb.convert = htSelectConversion(window->fb.format);
+  if (!window->fb.convert) return HT_ERROR_NONE;
+  window->fb.pitch = window->fb.format == HT_PIXEL_FORMAT_RGB565 ?
+    window->info.width << 1 : window->info.width << 2;
+  /* Keep rows aligned for the vector loads of the kernels */
+  window->fb.pitch = (window->fb.pitch + 31) & ~31u;
+  window->fb.pixels = malloc((size_t) window->fb.pitch * window->info.height);
+  if (!window->fb.pixels) {
+    htDestroyFramebufferImage(window);
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_MEMORY_ALLOCATION);
+  }
+  return HT_ERROR_NONE;
+}
+
+static int
+htResizeFramebuffer(HTWindow* window, const char* func) {
+  /* Buffers follow the window size, which drops their previous content */
+  if (!window->fb.count ||
+      (FB_IMAGE(window)->width  == (int) window->info.width &&
+       FB_IMAGE(window)->height == (int) window->info.height)) {
+    return HT_ERROR_NONE;
+  }
+  htDestroyFramebufferImage(window);
+  return htAllocateFramebuffer(window, func);
+}
+
+static HTWindow*
+htFindWindow(HTInstance* instance, Window win) {
+  /* Caller holds ht_lock for as long as it uses the window */
+  HTWindow* window = NULL;
+  for (window = instance->windows; window; window = window->next) {
+    if (window->win == win) break;
+  }
+  return window;
+}
+
+static Bool
+htIsPresentEvent(Display* display, XEvent* event, XPointer data) {
+  const HTInstance* instance = (const HTInstance*) data;
+  (void) display;
+  return instance->present_opcode && event->type == GenericEvent &&
+    event->xcookie.extension == instance->present_opcode;
+}
+
+static Bool
+htIsFramebufferEvent(Display* display, XEvent* event, XPointer data) {
+  const HTWindow* window = (const HTWindow*) data;
+  /* Present events only name their window once the cookie is read */
+  return (event->type == window->instance->shm_completion &&
+    event->xany.window == window->win) ||
+    htIsPresentEvent(display, event, (XPointer) window->instance);
+}
+
+static void
+htShmCompletion(HTWindow* window, XEvent* event) {
+  const XShmCompletionEvent* completion = (XShmCompletionEvent*) event;
+  unsigned i = 0;
+  for (i = 0; i < window->fb.count; ++i) {
+    if (window->fb.buffer[i].shm.shmseg == completion->shmseg) {
+      window->fb.buffer[i].busy = 0;
+    }
+  }
+}
+
+static void
+htPresentNotify(HTInstance* instance, XEvent* event) {
+  XGenericEventCookie* cookie = &event->xcookie;
+  HTWindow* window = NULL;
+  unsigned i = 0;
+  if (!XGetEventData(instance->dpy, cookie)) return;
+  /* Events may belong to any window of the instance, which another thread
+   * may destroy unless it is found and updated under one lock */
+  LOCK();
+  window = htFindWindow(
+    instance, ((XPresentCompleteNotifyEvent*) cookie->data)->window);
+  if (window && cookie->evtype == PresentCompleteNotify) {
+    const XPresentCompleteNotifyEvent* complete = cookie->data;
+    window->fb.info.serial = complete->serial_number;
+    window->fb.info.ust    = complete->ust;
+    window->fb.info.msc    = complete->msc;
+    window->fb.info.flip   = complete->mode == PresentCompleteModeFlip;
+    window->fb.done = 1;
+  } else if (window && cookie->evtype == PresentIdleNotify) {
+    const XPresentIdleNotifyEvent* idle = cookie->data;
+    for (i = 0; i < window->fb.count; ++i) {
+      if (window->fb.buffer[i].pixmap == idle->pixmap) {
+        window->fb.buffer[i].busy = 0;
+      }
+    }
+  }
+  UNLOCK();
+  XFreeEventData(instance->dpy, cookie);
+}
+
+static unsigned
+htIsBusy(HTWindow* window, unsigned i) {
+  /* Idle notifications may be handled by threads polling other windows */
+  unsigned busy = 0;
+  LOCK();
+  busy = window->fb.buffer[i].busy;
+  UNLOCK();
+  return busy;
+}
+
+static void
+htNextFramebuffer(HTWindow* window) {
+  XEvent event = {0};
+  unsigned i = 0;
+  unsigned next = 0;
+  /* Release buffers whose completion is already queued */
+  while (XCheckIfEvent(
+      DPY(window), &event, htIsFramebufferEvent, (XPointer) window)) {
+    if (event.type == GenericEvent) htPresentNotify(window->instance, &event);
+    else htShmCompletion(window, &event);
+  }
+  for (i = 1; i <= window->fb.count; ++i) {
+    next = (window->fb.current + i) % window->fb.count;
+    if (!htIsBusy(window, next)) break;
+  }
+  /* Every buffer is in flight, so wait for the oldest one */
+  if (i > window->fb.count) {
+    next = (window->fb.current + 1) % window->fb.count;
+  }
+  while (htIsBusy(window, next)) {
+    XIfEvent(DPY(window), &event, htIsFramebufferEvent, (XPointer) window);
+    if (event.type == GenericEvent) htPresentNotify(window->instance, &event);
+    else htShmCompletion(window, &event);
+  }
+  window->fb.current = next;
+}
+
+static int
+htClipRect(const HTRect* rect, int width, int height, int* clip) {
+  /* Clip to x, y, width, height within the given area */
+  clip[0] = rect->x < 0 ? 0 : rect->x;
+  clip[1] = rect->y < 0 ? 0 : rect->y;
+  clip[2] = HT_MIN(rect->x + (int) rect->width, width) - clip[0];
+  clip[3] = HT_MIN(rect->y + (int) rect->height, height) - clip[1];
+  return clip[2] > 0 && clip[3] > 0;
+}
+
+static unsigned
+htGetGLDamage(
+    HTWindow* window, const HTRect* rect, unsigned count, int* damage) {
+  /* Flip into bottom-left origin, merging rectangles that do not fit */
+  HTRect bounds = {0};
+  unsigned i = 0;
+  unsigned n = 0;
+  if (count > HT_GL_DAMAGE_SIZE) {
+    int x1 = rect[0].x;
+    int y1 = rect[0].y;
+    int x2 = rect[0].x + (int) rect[0].width;
+    int y2 = rect[0].y + (int) rect[0].height;
+    for (i = 1; i < count; ++i) {
+      const int right  = rect[i].x + (int) rect[i].width;
+      const int bottom = rect[i].y + (int) rect[i].height;
+      if (rect[i].x < x1) x1 = rect[i].x;
+      if (rect[i].y < y1) y1 = rect[i].y;
+      if (right  > x2) x2 = right;
+      if (bottom > y2) y2 = bottom;
+    }
+    bounds.x      = x1;
+    bounds.y      = y1;
+    bounds.width  = x2 - x1;
+    bounds.height = y2 - y1;
+    rect  = &bounds;
+    count = 1;
+  }
+  for (i = 0; i < count; ++i) {
+    int* const clip = damage + (n << 2);
+    if (!htClipRect(
+          &rect[i], window->info.width, window->info.height, clip)) {
+      continue;
+    }
+    clip[1] = (int) window->info.height - clip[1] - clip[3];
+    ++n;
+  }
+  return n;
+}
+
+static int
+htConfigureWindow(HTWindow* window, unsigned mask) {
+  XWindowChanges changes = {0};
+  if (!mask) return HT_ERROR_NONE;
+  if (!window->win) {
+    /* Offscreen windows only have a size */
+    if (window->gl.context && (mask & (CWWidth | CWHeight))) {
+      return htResizePbuffer(window);
+    }
+    return HT_ERROR_NONE;
+  }
+  LOCK();
+  if (window->instance->update) {
+    /* Sent as one request per window once the update is committed */
+    window->configure |= mask;
+    UNLOCK();
+    return HT_ERROR_NONE;
+  }
+  UNLOCK();
+  /* One request for all changed fields, answered by one ConfigureNotify */
+  changes.x      = window->info.x;
+  changes.y      = window->info.y;
+  changes.width  = window->info.width;
+  changes.height = window->info.height;
+  XConfigureWindow(DPY(window), window->win, mask, &changes);
+  return HT_ERROR_NONE;
+}
+
+static long
+htGetEventMask(HTWindow* window) {
+  /* Geometry is tracked even without handlers, window manager state only
+   * while it may still change the fullscreen mode */
+  long mask = StructureNotifyMask;
+  if (window->info.fullscreen || window->info.pending) {
+    mask |= PropertyChangeMask;
+  }
+  if (window->event.focus || window->hid.grab || window->hid.opcode) {
+    mask |= FocusChangeMask;
+  }
+  if (window->event.draw) mask |= ExposureMask;
+  return mask;
+}
+
+static void
+htSelectRawInput(HTInstance* instance) {
+  const HTWindow* window = NULL;
+  XIEventMask event_mask = {0};
+  unsigned char raw_mask[XIMaskLen(XI_LASTEVENT)] = {0};
+  unsigned raw = 0;
+  LOCK();
+  if (!instance->dpy || !instance->xi_opcode) {
+    UNLOCK();
+    return;
+  }
+  /* Root selection is shared, so it carries the union of windows. Mouse
+   * state is polled with or without a handler, so every input manager
+   * keeps it */
+  for (window = instance->windows; window; window = window->next) {
+    if (window->hid.opcode) raw = 1;
+  }
+  event_mask.deviceid = XIAllMasterDevices;
+  event_mask.mask_len = sizeof (raw_mask);
+  event_mask.mask = raw_mask;
+  if (raw) {
+    XISetMask(event_mask.mask, XI_RawButtonPress);
+    XISetMask(event_mask.mask, XI_RawButtonRelease);
+    XISetMask(event_mask.mask, XI_RawMotion);
+  }
+  /* Raw input must be sent to root or else XISelectEvents() returns BadValue */
+  XISelectEvents(
+    instance->dpy, DefaultRootWindow(instance->dpy), &event_mask, 1);
+  UNLOCK();
+}
+
+static void
+htSelectEvents(HTWindow* window) {
+  const long mask = htGetEventMask(window);
+  if (window->win && mask != window->mask) {
+    Window focus = None;
+    int revert = 0;
+    XSelectInput(DPY(window), window->win, mask);
+    /* Focus changes were not tracked before, so read the current state */
+    if (!(window->mask & FocusChangeMask) && (mask & FocusChangeMask)) {
+      XGetInputFocus(DPY(window), &focus, &revert);
+      window->info.focus = focus == window->win;
+    }
+    window->mask = mask;
+  }
+  htSelectRawInput(window->instance);
+}
+
+static void
+htSetFullscreen(HTWindow* window) {
+  HTInstance* const instance = window->instance;
+  const long bypass = window->info.fullscreen;
+  XEvent event = {0};
+  /* Answer of the window manager is only read while it is pending */
+  window->info.pending = 1;
+  htSelectEvents(window);
+  /* Ask compositing managers to unredirect the window, so frames flip */
+  XChangeProperty(
+    DPY(window),
+    window->win,
+    instance->wm_bypass,
+    XA_CARDINAL,
+    32,
+    PropModeReplace,
+    (unsigned char*) &bypass,
+    1);
+  /* Mapped windows change state through the window manager (EWMH) */
+  event.xclient.type         = ClientMessage;
+  event.xclient.window       = window->win;
+  event.xclient.message_type = instance->wm_state;
+  event.xclient.format       = 32;
+  event.xclient.data.l[0]    = window->info.fullscreen; /* Add or remove */
+  event.xclient.data.l[1]    = (long) instance->wm_fullscreen;
+  event.xclient.data.l[3]    = 1; /* Request comes from an application */
+  XSendEvent(
+    DPY(window),
+    DefaultRootWindow(DPY(window)),
+    False,
+    SubstructureNotifyMask | SubstructureRedirectMask,
+    &event);
+}
+
+static unsigned
+htStageAttribute(HTWindow* window, unsigned flag, const char* title) {
+  /* Sent with the staged geometry once the update is committed */
+  char* copy = NULL;
+  unsigned staged = 0;
+  LOCK();
+  if (window->instance->update && flag == HT_STAGE_TITLE) {
+    /* Title is sent right away if it cannot be kept until then */
+    copy = malloc(strlen(title) + 1);
+    if (copy) {
+      free(window->title);
+      window->title = strcpy(copy, title);
+      staged = 1;
+    }
+  } else if (window->instance->update) {
+    staged = 1;
+  }
+  if (staged) window->staged |= flag;
+  UNLOCK();
+  return staged;
+}
+
+static void
+htPropertyNotify(HTWindow* window) {
+  Atom type = None;
+  Atom* state = NULL;
+  unsigned long count = 0;
+  unsigned long after = 0;
+  unsigned long i = 0;
+  int format = 0;
+  /* Window manager may refuse or revoke fullscreen at any time */
+  window->info.fullscreen = 0;
+  window->info.pending = 0;
+  if (XGetWindowProperty(
+        DPY(window),
+        window->win,
+        window->instance->wm_state,
+        0,
+        64,
+        False,
+        XA_ATOM,
+        &type,
+        &format,
+        &count,
+        &after,
+        (unsigned char**) &state) != Success) {
+    htSelectEvents(window);
+    return;
+  }
+  for (i = 0; state && i < count; ++i) {
+    if (state[i] == window->instance->wm_fullscreen) {
+      window->info.fullscreen = 1;
+    }
+  }
+  if (state) XFree(state);
+  /* Windows that left fullscreen stop tracking the state */
+  htSelectEvents(window);
+}
+
+static Window
+htGetCompositor(HTInstance* instance) {
+  /* Owner of the compositing manager selection, None without compositor */
+  Display* const dpy = instance->dpy;
+  Window owner = None;
+  int error = 0;
+  LOCK();
+  if (!(instance->probed & HT_PROBE_COMPOSITOR)) {
+    /* Owner is kept current through notifications on the root */
+    if (XFixesQueryExtension(dpy, &instance->fixes_event, &error)) {
+      XFixesSelectSelectionInput(
+        dpy,
+        DefaultRootWindow(dpy),
+        instance->wm_cm,
+        XFixesSetSelectionOwnerNotifyMask |
+        XFixesSelectionWindowDestroyNotifyMask |
+        XFixesSelectionClientCloseNotifyMask);
+      instance->cm_owner = XGetSelectionOwner(dpy, instance->wm_cm);
+    } else {
+      instance->fixes_event = 0;
+    }
+    instance->probed |= HT_PROBE_COMPOSITOR;
+  }
+  owner = instance->cm_owner;
+  UNLOCK();
+  /* Without XFixes the owner can only be asked for every time */
+  if (!instance->fixes_event) owner = XGetSelectionOwner(dpy, instance->wm_cm);
+  return owner;
+}
+
+static int
+htIsUnredirected(HTWindow* window) {
+  /* X gives no direct answer, so flips and a missing compositor count */
+  if (window->fb.info.flip) return 1;
+  if (!window->win) return 0;
+  return htGetCompositor(window->instance) == None;
+}
+
+static int
+htGetWindowMonitor(HTWindow* window) {
+  /* Monitor sharing the largest area with the window, -1 if none */
+  HTInstance* const instance = window->instance;
+  Window child = None;
+  int x = 0;
+  int y = 0;
+  long x1 = 0;
+  long y1 = 0;
+  long x2 = 0;
+  long y2 = 0;
+  unsigned long best = 0;
+  unsigned i = 0;
+  int index = -1;
+  if (!window->win) return -1;
+  /* ConfigureNotify reports positions relative to the frame a reparenting
+   * window manager puts around the window, monitors are in root space */
+  if (!XTranslateCoordinates(
+        DPY(window),
+        window->win,
+        DefaultRootWindow(DPY(window)),
+        0,
+        0,
+        &x,
+        &y,
+        &child)) {
+    x = window->info.x;
+    y = window->info.y;
+  }
+  x1 = x;
+  y1 = y;
+  x2 = x1 + window->info.width;
+  y2 = y1 + window->info.height;
+  htValidateMonitors(instance);
+  LOCK();
+  for (i = 0; i < instance->monitors; ++i) {
+    const HTMonitor* const monitor = &instance->monitor[i];
+    const long left   = HT_MAX(x1, monitor->x);
+    const long top    = HT_MAX(y1, monitor->y);
+    const long right  = HT_MIN(x2, monitor->x + (long) monitor->width);
+    const long bottom = HT_MIN(y2, monitor->y + (long) monitor->height);
+    unsigned long area = 0;
+    if (right <= left || bottom <= top) continue;
+    area = (unsigned long) (right - left) * (bottom - top);
+    if (area > best) {
+      best  = area;
+      index = i;
+    }
+  }
+  UNLOCK();
+  return index;
+}
+
+static int
+htGetWindowRefreshRate(HTWindow* window) {
+  const int index = htGetWindowMonitor(window);
+  int refresh = 0;
+  if (index < 0) return 0;
+  LOCK();
+  refresh = window->instance->monitor[index].refresh;
+  UNLOCK();
+  return refresh;
+}
+
+static Bool
+htIsRandREvent(Display* display, XEvent* event, XPointer data) {
+  const HTInstance* instance = (const HTInstance*) data;
+  (void) display;
+  return event->type == instance->rr_event + RRScreenChangeNotify ||
+    event->type == instance->rr_event + RRNotify;
+}
+
+static int
+htGrabPointer(HTWindow* window) {
+  HTInstance* const instance = window->instance;
+  int result = 0;
+  LOCK();
+  if (!instance->blank) {
+    /* Cursor from an empty 1x1 bitmap hides the pointer while captured */
+    static const char bits[1] = {0};
+    XColor black = {0};
+    const Pixmap pixmap = XCreateBitmapFromData(
+      instance->dpy, DefaultRootWindow(instance->dpy), bits, 1, 1);
+    instance->blank = XCreatePixmapCursor(
+      instance->dpy, pixmap, pixmap, &black, &black, 0, 0);
+    XFreePixmap(instance->dpy, pixmap);
+  }
+  UNLOCK();
+  /* Raw motion keeps reporting deltas at the edges, so no warps needed */
+  result = XGrabPointer(
+    DPY(window),
+    window->win,
+    False,
+    0,
+    GrabModeAsync,
+    GrabModeAsync,
+    window->win,
+    instance->blank,
+    CurrentTime);
+  window->hid.grabbed = result == GrabSuccess;
+  return window->hid.grabbed;
+}
+
+static void
+htUngrabPointer(HTWindow* window) {
+  if (!window->hid.grabbed) return;
+  XUngrabPointer(DPY(window), CurrentTime);
+  window->hid.grabbed = 0;
+}
+
+static void
+htPollMonitorEvents(HTInstance* instance) {
+  XEvent event = {0};
+  while (instance->rr_event && XCheckIfEvent(
+      instance->dpy, &event, htIsRandREvent, (XPointer) instance)) {
+    XRRUpdateConfiguration(&event);
+    LOCK();
+    instance->stale = 1;
+    UNLOCK();
+  }
+}
+
+static Bool
+htIsSelectionEvent(Display* display, XEvent* event, XPointer data) {
+  const HTInstance* instance = (const HTInstance*) data;
+  (void) display;
+  return event->type == instance->fixes_event + XFixesSelectionNotify;
+}
+
+static void
+htPollSelectionEvents(HTInstance* instance) {
+  XEvent event = {0};
+  while (instance->fixes_event && XCheckIfEvent(
+      instance->dpy, &event, htIsSelectionEvent, (XPointer) instance)) {
+    const XFixesSelectionNotifyEvent* notify =
+      (const XFixesSelectionNotifyEvent*) &event;
+    /* Selection has no owner once its window or client is gone */
+    LOCK();
+    instance->cm_owner = notify->subtype == XFixesSetSelectionOwnerNotify ?
+      notify->owner : None;
+    UNLOCK();
+  }
+}
+
+static Bool
+htIsOrphanEvent(Display* display, XEvent* event, XPointer data) {
+  /* Left over events of client windows that were destroyed or deselected
+   * them, and completions of framebuffers that were destroyed. Root window
+   * events, e.g. of RandR, and other extensions than MIT-SHM are never
+   * taken. */
+  const htWindowList* list = (const htWindowList*) data;
+  const int shm = event->type == list->instance->shm_completion;
+  unsigned i = 0;
+  if (event->type == GenericEvent ||
+      (event->type >= LASTEvent && !shm) ||
+      event->xany.window == DefaultRootWindow(display)) {
+    return False;
+  }
+  for (i = 0; i < list->count; ++i) {
+    if (list->win[i] == event->xany.window) return shm && !list->fb[i];
+  }
+  return True;
+}
+
+static int
+htSnapshotWindows(HTInstance* instance, unsigned* count) {
+  /* Caller holds ht_lock, buffers stay with the instance between calls */
+  HTWindow* window = NULL;
+  void* grown = NULL;
+  unsigned n = 0;
+  for (window = instance->windows; window; window = window->next) ++n;
+  if (n > instance->snapshot_size) {
+    grown = realloc(instance->snapshot, n * sizeof (*instance->snapshot));
+    if (!grown) return 0;
+    instance->snapshot = grown;
+    grown = realloc(instance->snapshot_win, n * sizeof (Window));
+    if (!grown) return 0;
+    instance->snapshot_win = grown;
+    grown = realloc(instance->snapshot_fb, n);
+    if (!grown) return 0;
+    instance->snapshot_fb = grown;
+    instance->snapshot_size = n;
+  }
+  n = 0;
+  for (window = instance->windows; window; window = window->next) {
+    instance->snapshot[n]     = window;
+    instance->snapshot_win[n] = window->win;
+    instance->snapshot_fb[n]  = window->fb.count != 0;
+    ++n;
+  }
+  *count = n;
+  return 1;
+}
+
+static unsigned
+htIsRegistered(HTInstance* instance, const HTWindow* window) {
+  const HTWindow* other = NULL;
+  LOCK();
+  for (other = instance->windows; other; other = other->next) {
+    if (other == window) break;
+  }
+  UNLOCK();
+  return other != NULL;
+}
+
 static void
 htConfigureNotify(HTWindow* window, XEvent* event) {
-  if (window->info.width  != event->xconfigure.width ||
-      window->info.height != event->xconfigure.height) {
+  const char* func = "htPollWindowEvents";
+  if (window->info.width  != (unsigned) event->xconfigure.width ||
+      window->info.height != (unsigned) event->xconfigure.height) {
     window->info.width  = event->xconfigure.width;
     window->info.height = event->xconfigure.height;
+    htResizeFramebuffer(window, func);
     HT_HANDLE_EVENT(window, window->event.resize);
   } else {
+    /* Sizes set by the user were stored before the server applied them */
+    htResizeFramebuffer(window, func);
     window->info.x = event->xconfigure.x;
     window->info.y = event->xconfigure.y;
     HT_HANDLE_EVENT(window, window->event.move);
   }
 }
 
+int
+htCreateInstance(HTInstance** instance, const char* display) {
+  const char* func = "htCreateInstance";
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(!*instance, func, HT_ERROR_INVALID_ARGUMENT);
+  LOCK();
+  *instance = htOpenInstance(display);
+  UNLOCK();
+  if (!*instance) return HANDLE_ERROR(func, HT_ERROR_MEMORY_ALLOCATION);
+  if (!(*instance)->dpy) {
+    free((*instance)->name);
+    free(*instance);
+    *instance = NULL;
+    return HANDLE_ERROR(func, HT_ERROR_WINDOW_SERVER);
+  }
+  /* Reference held by the user until htDestroyInstance */
+  (*instance)->refs = 1;
+  return HT_ERROR_NONE;
+}
+
 int
 htCreateWindow(
-    HTWindow** window, short x, short y, unsigned short w, unsigned short h) {
-  const char* func = "htCreateWindow";
-  Atom delete = 0;
-  XWindowAttributes attribute = {0};
-  XSizeHints hint = {0};
+    HTWindow** window, int x, int y, unsigned w, unsigned h) {
+  HTWindowDesc desc = {0};
+  desc.x      = x;
+  desc.y      = y;
+  desc.width  = w;
+  desc.height = h;
+  return htCreateWindows(window, &desc, 1);
+}
+
+int
+htCreateOffscreenWindow(
+    HTWindow** window, HTInstance* owner, unsigned w, unsigned h) {
+  const char* func = "htCreateOffscreenWindow";
+  HTInstance* instance = NULL;
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(!*window, func, HT_ERROR_INVALID_ARGUMENT);
-  if (!dpy) {
-    /* Open connection to X server */
-    dpy = XOpenDisplay(NULL);
-    if (!dpy) return HANDLE_ERROR(func, HT_ERROR_WINDOW_SERVER);
+  if (!(w && h)) {
+    return INSTANCE_ERROR(owner, func, HT_ERROR_INVALID_ARGUMENT);
+  }
+  instance = htRetainInstance(owner, 1);
+  if (!instance) {
+    return INSTANCE_ERROR(owner, func, HT_ERROR_MEMORY_ALLOCATION);
   }
+#ifndef HT_USE_EGL
+  /* EGL falls back to the surfaceless platform without an X server */
+  if (!instance->dpy) {
+    INSTANCE_ERROR(instance, func, HT_ERROR_WINDOW_SERVER);
+    htReleaseInstance(instance, 1);
+    return HT_ERROR_WINDOW_SERVER;
+  }
+#endif
   *window = calloc(1, sizeof (HTWindow));
-  if (!*window) return HANDLE_ERROR(func, HT_ERROR_MEMORY_ALLOCATION);
-  (*window)->win = XCreateSimpleWindow(
-    dpy, DefaultRootWindow(dpy), x, y, w, h, 1, 0, 0);
-  if (!(*window)->win) return HANDLE_ERROR(func, HT_ERROR_WINDOW_SERVER);
-  delete = XInternAtom(dpy, "WM_DELETE_WINDOW", True);
-  XSetWMProtocols(dpy, (*window)->win, &delete, 1);
-  /* Set hints to ensure window is positioned and sized correctly */
-  hint.flags  = PPosition | PSize;
-  hint.x      = x;
-  hint.y      = y;
-  hint.width  = w;
-  hint.height = h;
-  XSetNormalHints(dpy, (*window)->win, &hint);
-  XSelectInput(dpy, (*window)->win, HT_EVENT_MASK);
-  XMapRaised(dpy, (*window)->win);
-  /* Force X to write buffered requests */
-  XFlush(dpy);
+  if (!*window) {
+    /* Report while the reference still keeps the instance alive */
+    INSTANCE_ERROR(instance, func, HT_ERROR_MEMORY_ALLOCATION);
+    htReleaseInstance(instance, 1);
+    return HT_ERROR_MEMORY_ALLOCATION;
+  }
+  htRegisterWindow(*window, instance);
+  (*window)->fb.buffers = 1;
+  /* Pbuffer of this size is created along with the OpenGL context */
+  (*window)->info.width  = w;
+  (*window)->info.height = h;
   /* Initialize OpenGL context defaults */
   INIT_GL_DEFAULTS(*window);
 #ifndef HT_DISABLE_DEBUG
   /* Set GUID for argument validation */
   (*window)->uid = GUID;
 #endif
-  /* Store window info */
-  XGetWindowAttributes(dpy, (*window)->win, &attribute);
-  /* TODO: Value shouldn't be 0 because of title bar/dock */
-  (*window)->info.x      = attribute.x;
-  (*window)->info.y      = attribute.y;
-  (*window)->info.width  = attribute.width;
-  (*window)->info.height = attribute.height;
+  return HT_ERROR_NONE;
+}
+
+int
+htCreateWindows(HTWindow** window, const HTWindowDesc* desc, unsigned count) {
+  const char* func = "htCreateWindows";
+  XSizeHints hint = {0};
+  unsigned i = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(desc || !count, func, HT_ERROR_INVALID_ARGUMENT);
+  for (i = 0; i < count; ++i) {
+    HTInstance* const instance = htRetainInstance(desc[i].instance, 1);
+    Display* const dpy = instance ? instance->dpy : NULL;
+    ASSERT(!window[i], func, HT_ERROR_INVALID_ARGUMENT);
+    window[i] = dpy ? calloc(1, sizeof (HTWindow)) : NULL;
+    if (window[i]) {
+      window[i]->win = XCreateSimpleWindow(
+        dpy,
+        DefaultRootWindow(dpy),
+        HT_CLAMP_POSITION(desc[i].x),
+        HT_CLAMP_POSITION(desc[i].y),
+        HT_CLAMP_SIZE(desc[i].width),
+        HT_CLAMP_SIZE(desc[i].height),
+        1,
+        0,
+        0);
+    }
+    if (!(window[i] && window[i]->win)) {
+      const int result = (instance && !dpy) || window[i] ?
+        HT_ERROR_WINDOW_SERVER : HT_ERROR_MEMORY_ALLOCATION;
+      free(window[i]);
+      window[i] = NULL;
+      /* Release every window of the batch created so far */
+      while (i--) htDestroyWindow(&window[i]);
+      /* Report while the reference still keeps the instance alive */
+      INSTANCE_ERROR(instance, func, result);
+      if (instance) htReleaseInstance(instance, 1);
+      return result;
+    }
+    htRegisterWindow(window[i], instance);
+    window[i]->fb.buffers = 1;
+    XSetWMProtocols(dpy, window[i]->win, &instance->wm_delete_window, 1);
+    /* Set hints to ensure window is positioned and sized correctly */
+    hint.flags  = PPosition | PSize;
+    hint.x      = HT_CLAMP_POSITION(desc[i].x);
+    hint.y      = HT_CLAMP_POSITION(desc[i].y);
+    hint.width  = HT_CLAMP_SIZE(desc[i].width);
+    hint.height = HT_CLAMP_SIZE(desc[i].height);
+    XSetNormalHints(dpy, window[i]->win, &hint);
+    if (desc[i].title) XStoreName(dpy, window[i]->win, desc[i].title);
+    window[i]->mask = htGetEventMask(window[i]);
+    XSelectInput(dpy, window[i]->win, window[i]->mask);
+    XMapRaised(dpy, window[i]->win);
+    /* Initialize OpenGL context defaults */
+    INIT_GL_DEFAULTS(window[i]);
+#ifndef HT_DISABLE_DEBUG
+    /* Set GUID for argument validation */
+    window[i]->uid = GUID;
+#endif
+    /* Requested geometry is kept until the first ConfigureNotify arrives */
+    window[i]->info.x      = HT_CLAMP_POSITION(desc[i].x);
+    window[i]->info.y      = HT_CLAMP_POSITION(desc[i].y);
+    window[i]->info.width  = HT_CLAMP_SIZE(desc[i].width);
+    window[i]->info.height = HT_CLAMP_SIZE(desc[i].height);
+  }
+  /* Force X to write all buffered requests of the batch at once, flushing
+   * an already written connection again is a no-op */
+  for (i = 0; i < count; ++i) htFlush(window[i]->instance, HT_FLUSH_ALWAYS);
   return HT_ERROR_NONE;
 }
 
 int
 htCreateGLContext(HTWindow* window) {
   const char* func = "htCreateGLContext";
-  LOAD_GLX(PFNGLXCREATECONTEXTATTRIBSARBPROC, glXCreateContextAttribsARB);
-  const GLXContext prev = glXGetCurrentContext();
-  GLXFBConfig* fbc = NULL;
-  int value = 0;
+  const htGLContext prev = GET_CURRENT_CONTEXT();
+  const htGLDrawable prev_drawable = GET_CURRENT_DRAWABLE();
+  htGLConfig fbc = NULL;
+  int attrib[HT_GL_PFA_SIZE] = {0};
+  int result = HT_ERROR_NONE;
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
   ASSERT(!window->gl.context, func, HT_ERROR_GL_CONTEXT_CREATION);
-  ASSERT(dpy, func, HT_ERROR_WINDOW_SERVER);
-  if (htCreateGLPixelFormat(window, &fbc) != HT_ERROR_NONE) {
-    return HANDLE_ERROR(func, HT_ERROR_GL_CONTEXT_CREATION);
+  if (!htInitGLDisplay(window->instance)) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_WINDOW_SERVER);
   }
-  /* Create OpenGL context */
-  if (glXCreateContextAttribsARB) {
-    int version[] = {
-      GLX_CONTEXT_MAJOR_VERSION_ARB, -1,
-      GLX_CONTEXT_MINOR_VERSION_ARB, -1,
-      None};
-    version[1] = window->gl.major;
-    version[3] = window->gl.minor;
-    window->gl.context = glXCreateContextAttribsARB(dpy, *fbc, 0, 1, version);
-  } else if (window->gl.major < 3) {
-    XVisualInfo* info = glXGetVisualFromFBConfig(dpy, *fbc);
-    window->gl.context = glXCreateContext(dpy, info, 0, 1);
-    XFree(info);
-  } else {
-    return HANDLE_ERROR(func, HT_ERROR_GL_CONTEXT_CREATION);
+  /* Pixel format failures are reported where they happen */
+  result = htCreateGLPixelFormat(window, &fbc, attrib);
+  if (result != HT_ERROR_NONE) return result;
+  window->gl.drawable = htCreateGLDrawable(window, fbc);
+  if (!window->gl.drawable) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_GL_CONTEXT_CREATION);
   }
+  /* Create OpenGL context */
+  window->gl.context = htCreateContext(window, fbc, NULL);
   if (!(window->gl.context &&
-      glXMakeCurrent(dpy, window->win, window->gl.context))) {
-    XFree(fbc);
-    glXMakeCurrent(dpy, -(prev != NULL) & window->win, prev);
-    return HANDLE_ERROR(func, HT_ERROR_GL_CONTEXT_CREATION);
+      MAKE_CURRENT(GL_DPY(window), window->gl.drawable, window->gl.context))) {
+    if (window->gl.context) DESTROY_CONTEXT(GL_DPY(window), window->gl.context);
+    htDestroyGLDrawable(window);
+    window->gl.context  = NULL;
+    window->gl.drawable = 0;
+    MAKE_CURRENT(GL_DPY(window), prev_drawable, prev);
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_GL_CONTEXT_CREATION);
   }
   htSetSwapInterval(window);
-  /* Overwrite user values with pixel format attributes obtained */
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_RED_SIZE, &value);
-  window->gl.red = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_BLUE_SIZE, &value);
-  window->gl.green = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_GREEN_SIZE, &value);
-  window->gl.blue = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_ALPHA_SIZE, &value);
-  window->gl.alpha = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_DEPTH_SIZE, &value);
-  window->gl.depth = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_STENCIL_SIZE, &value);
-  window->gl.stencil = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_ACCUM_RED_SIZE, &value);
-  window->gl.accum = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_ACCUM_GREEN_SIZE, &value);
-  window->gl.accum += value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_ACCUM_BLUE_SIZE, &value);
-  window->gl.accum += value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_ACCUM_ALPHA_SIZE, &value);
-  window->gl.accum += value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_AUX_BUFFERS, &value);
-  window->gl.aux_buffers = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_SAMPLE_BUFFERS, &value);
-  window->gl.sample_buffers = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_SAMPLES, &value);
-  window->gl.samples = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_DOUBLEBUFFER, &value);
-  window->gl.double_buffer = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_CONFIG_CAVEAT, &value);
-  window->gl.accelerated = value == GLX_NONE;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_STEREO, &value);
-  window->gl.stereo = value;
-  glXGetFBConfigAttrib(dpy, *fbc, GLX_RENDER_TYPE, &value);
-  window->gl.pixel_type = value == GLX_RGBA_BIT;
+  htReadGLConfig(window, attrib);
+  window->gl.config = fbc;
   window->gl.major = glGetString(GL_VERSION)[0] - '0';
   window->gl.minor = glGetString(GL_VERSION)[2] - '0';
   window->gl.profile = window->gl.major > 2;
   window->gl.color =
     window->gl.red + window->gl.green + window->gl.blue + window->gl.alpha;
-  XFree(fbc);
-  glXMakeCurrent(dpy, -(prev != NULL) & window->win, prev);
+  MAKE_CURRENT(GL_DPY(window), prev_drawable, prev);
+  return HT_ERROR_NONE;
+}
+
+int
+htCreateSharedGLContexts(HTWindow* window, unsigned count) {
+  const char* func = "htCreateSharedGLContexts";
+  int drawable = 0;
+  unsigned i = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  ASSERT(window->gl.context, func, HT_ERROR_UNINITIALIZED_GL_CONTEXT);
+  ASSERT(!window->pool.count, func, HT_ERROR_GL_CONTEXT_CREATION);
+  ASSERT(GL_DPY(window), func, HT_ERROR_WINDOW_SERVER);
+  if (!count) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
+  }
+  window->pool.context = calloc(count, sizeof (htGLContext));
+  window->pool.pbuffer = calloc(count, sizeof (htGLDrawable));
+  window->pool.busy    = calloc(count, sizeof (unsigned char));
+  if (!(window->pool.context && window->pool.pbuffer && window->pool.busy)) {
+    htDestroySharedGLContexts(window);
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_MEMORY_ALLOCATION);
+  }
+  window->pool.count = count;
+  pthread_mutex_init(&window->pool.lock, NULL);
+  /* Contexts are created with the API bound on the calling thread */
+  (void) BIND_API();
+  /* Contexts without a pbuffer are made current without a drawable */
+  GET_CONFIG_ATTRIB(
+    GL_DPY(window), window->gl.config, PF_DRAWABLE_TYPE, &drawable);
+  for (i = 0; i < count; ++i) {
+    window->pool.context[i] =
+      htCreateContext(window, window->gl.config, window->gl.context);
+    if (!window->pool.context[i]) {
+      htDestroySharedGLContexts(window);
+      return INSTANCE_ERROR(
+        window->instance, func, HT_ERROR_GL_CONTEXT_CREATION);
+    }
+    if (drawable & PF_PBUFFER_BIT) {
+      window->pool.pbuffer[i] =
+        htCreatePbuffer(window, window->gl.config, 1, 1);
+      if (!window->pool.pbuffer[i]) {
+        htDestroySharedGLContexts(window);
+        return INSTANCE_ERROR(
+          window->instance, func, HT_ERROR_GL_CONTEXT_CREATION);
+      }
+    }
+  }
+  return HT_ERROR_NONE;
+}
+
+int
+htCreateGLPresentThread(HTWindow* window, unsigned frames) {
+  const char* func = "htCreateGLPresentThread";
+#ifndef HT_USE_EGL
+  const htGLContext prev = GET_CURRENT_CONTEXT();
+  const htGLDrawable prev_drawable = GET_CURRENT_DRAWABLE();
+  const char* ext = NULL;
+  int result = HT_ERROR_NONE;
+#endif
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  ASSERT(window->gl.context, func, HT_ERROR_UNINITIALIZED_GL_CONTEXT);
+  ASSERT(!window->present.context, func, HT_ERROR_GL_CONTEXT_CREATION);
+  ASSERT(frames, func, HT_ERROR_INVALID_ARGUMENT);
+#ifdef HT_USE_EGL
+  /* EGL surfaces cannot be current on two threads at once */
+  return INSTANCE_ERROR(
+    window->instance, func, HT_ERROR_GL_EXTENSIONS_MISSING);
+#else
+  /* Frames are copied without resolving, so samples could not be kept */
+  if (!window->win || window->gl.sample_buffers) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
+  }
+  /* Frame objects are created on the window context */
+  if (prev != window->gl.context) {
+    MAKE_CURRENT(GL_DPY(window), window->gl.drawable, window->gl.context);
+  }
+  ext = window->gl.major < 3 ? (const char*) glGetString(GL_EXTENSIONS) : "";
+  if (!ext || (window->gl.major < 3 &&
+      !strstr(ext, "GL_ARB_framebuffer_object"))) {
+    result = HT_ERROR_GL_EXTENSIONS_MISSING;
+  }
+  if (!result) {
+    window->present.context =
+      htCreateContext(window, window->gl.config, window->gl.context);
+    if (!window->present.context) result = HT_ERROR_GL_CONTEXT_CREATION;
+  }
+  if (!result) {
+    window->present.frames = HT_MIN(frames, HT_MAX_GL_FRAMES_IN_FLIGHT);
+    window->present.slots  = window->present.frames + 1;
+    window->present.glFenceSync = (PFNGLFENCESYNCPROC)
+      glXGetProcAddress((const GLubyte*) "glFenceSync");
+    window->present.glClientWaitSync = (PFNGLCLIENTWAITSYNCPROC)
+      glXGetProcAddress((const GLubyte*) "glClientWaitSync");
+    window->present.glDeleteSync = (PFNGLDELETESYNCPROC)
+      glXGetProcAddress((const GLubyte*) "glDeleteSync");
+    window->present.glGenFramebuffers = (PFNGLGENFRAMEBUFFERSPROC)
+      glXGetProcAddress((const GLubyte*) "glGenFramebuffers");
+    window->present.glDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC)
+      glXGetProcAddress((const GLubyte*) "glDeleteFramebuffers");
+    window->present.glBindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC)
+      glXGetProcAddress((const GLubyte*) "glBindFramebuffer");
+    window->present.glFramebufferRenderbuffer =
+      (PFNGLFRAMEBUFFERRENDERBUFFERPROC)
+      glXGetProcAddress((const GLubyte*) "glFramebufferRenderbuffer");
+    window->present.glCheckFramebufferStatus =
+      (PFNGLCHECKFRAMEBUFFERSTATUSPROC)
+      glXGetProcAddress((const GLubyte*) "glCheckFramebufferStatus");
+    window->present.glGenRenderbuffers = (PFNGLGENRENDERBUFFERSPROC)
+      glXGetProcAddress((const GLubyte*) "glGenRenderbuffers");
+    window->present.glDeleteRenderbuffers = (PFNGLDELETERENDERBUFFERSPROC)
+      glXGetProcAddress((const GLubyte*) "glDeleteRenderbuffers");
+    window->present.glBindRenderbuffer = (PFNGLBINDRENDERBUFFERPROC)
+      glXGetProcAddress((const GLubyte*) "glBindRenderbuffer");
+    window->present.glRenderbufferStorage = (PFNGLRENDERBUFFERSTORAGEPROC)
+      glXGetProcAddress((const GLubyte*) "glRenderbufferStorage");
+    window->present.glBlitFramebuffer = (PFNGLBLITFRAMEBUFFERPROC)
+      glXGetProcAddress((const GLubyte*) "glBlitFramebuffer");
+    if (!(window->present.glClientWaitSync && window->present.glDeleteSync)) {
+      window->present.glFenceSync = NULL;
+    }
+    if (!htCreateGLFrames(window)) {
+      htDestroyGLFrames(window);
+      result = HT_ERROR_GL_CONTEXT_CREATION;
+    }
+  }
+  if (!result) {
+    pthread_mutex_init(&window->present.lock, NULL);
+    pthread_cond_init(&window->present.queued, NULL);
+    pthread_cond_init(&window->present.done, NULL);
+    if (pthread_create(
+          &window->present.thread, NULL, htPresentThread, window)) {
+      pthread_cond_destroy(&window->present.queued);
+      pthread_cond_destroy(&window->present.done);
+      pthread_mutex_destroy(&window->present.lock);
+      htDestroyGLFrames(window);
+      result = HT_ERROR_GL_CONTEXT_CREATION;
+    }
+  }
+  if (result && window->present.context) {
+    DESTROY_CONTEXT(GL_DPY(window), window->present.context);
+  }
+  if (result) memset(&window->present, 0, sizeof (window->present));
+  if (prev != window->gl.context) {
+    MAKE_CURRENT(GL_DPY(window), prev_drawable, prev);
+  }
+  if (result) return INSTANCE_ERROR(window->instance, func, result);
   return HT_ERROR_NONE;
+#endif
+}
+
+int
+htCreateFramebuffer(HTWindow* window) {
+  const char* func = "htCreateFramebuffer";
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  ASSERT(!window->fb.count, func, HT_ERROR_INVALID_ARGUMENT);
+  /* Offscreen windows have nothing to present to, nor maybe a server */
+  if (!window->win) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
+  }
+  htProbeFramebuffer(window->instance);
+  return htAllocateFramebuffer(window, func);
 }
 
 int
 htCreateInputManager(HTWindow* window) {
   const char* func = "htCreateInputManager";
+  HTInstance* instance = NULL;
+  int event = 0;
   int error = 0;
-  int count = 0;
-  XIEventMask event_mask = {0};
-  unsigned char raw_mask[XIMaskLen(XI_LASTEVENT)] = {0};
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
-  ASSERT(!xi_dpy, func, HT_ERROR_WINDOW_SERVER);
-  if (!xi_dpy) {
-    /* Open connection to X server */
-    xi_dpy = XOpenDisplay(NULL);
-    if (!xi_dpy) return HANDLE_ERROR(func, HT_ERROR_WINDOW_SERVER);
+  ASSERT(!window->hid.opcode, func, HT_ERROR_WINDOW_SERVER);
+  instance = window->instance;
+  if (!instance->dpy) {
+    return INSTANCE_ERROR(instance, func, HT_ERROR_WINDOW_SERVER);
   }
+  LOCK();
   /* Raw input requires XInput 2.0 extension */
-  if (!XQueryExtension(
-        xi_dpy, "XInputExtension", &window->hid.opcode, &count, &error)) {
-    HANDLE_ERROR(func, HT_ERROR_INPUT_MANAGER_CREATION);
+  if (!instance->xi_opcode && !XQueryExtension(
+        instance->dpy,
+        "XInputExtension",
+        &instance->xi_opcode,
+        &event,
+        &error)) {
+    instance->xi_opcode = 0;
   }
-  /* Setup raw input events */
-  event_mask.deviceid = XIAllMasterDevices;
-  event_mask.mask_len = sizeof (raw_mask);
-  event_mask.mask = raw_mask;
-  XISetMask(event_mask.mask, XI_RawButtonPress);
-  XISetMask(event_mask.mask, XI_RawButtonRelease);
-  XISetMask(event_mask.mask, XI_RawMotion);
-  /* Raw input must be sent to root or else XISelectEvents() returns BadValue */
-  XISelectEvents(xi_dpy, DefaultRootWindow(xi_dpy), &event_mask, 1);
+  window->hid.opcode = instance->xi_opcode;
+  UNLOCK();
+  if (!window->hid.opcode) {
+    return INSTANCE_ERROR(instance, func, HT_ERROR_INPUT_MANAGER_CREATION);
+  }
+  /* Raw events arrive on the window connection, only while handled */
+  htSelectEvents(window);
   return HT_ERROR_NONE;
 }
 
 int
 htDestroyWindow(HTWindow** window) {
   const char* func = "htDestroyWindow";
+  HTInstance* instance = NULL;
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(window && VALID_WINDOW(*window), func, HT_ERROR_UNINITIALIZED_WINDOW);
-  ASSERT(dpy, func, HT_ERROR_WINDOW_SERVER);
-  XDestroyWindow(dpy, (*window)->win);
-  htShouldCloseDisplay();
+  instance = (*window)->instance;
+  ASSERT(instance->dpy || !(*window)->win, func, HT_ERROR_WINDOW_SERVER);
+  /* Present thread, pool and context all use the drawable of the window */
+  if ((*window)->gl.context) htDestroyGLContext(*window);
+  htDestroyFramebufferImage(*window);
+  if ((*window)->win) {
+    XDestroyWindow(instance->dpy, (*window)->win);
+    htFlush(instance, HT_FLUSH_ALWAYS);
+  }
+  htUnregisterWindow(*window);
+  /* Raw input of the instance may no longer be needed, even by no window */
+  if ((*window)->hid.opcode) htSelectRawInput(instance);
 #ifndef HT_DISABLE_DEBUG
   (*window)->uid = 0;
 #endif
+  free((*window)->title);
   free(*window);
   *window = NULL;
+  /* Closes the display connection once no window or user holds it */
+  htReleaseInstance(instance, 1);
+  return HT_ERROR_NONE;
+}
+
+int
+htDestroyInstance(HTInstance** instance) {
+  const char* func = "htDestroyInstance";
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(*instance, func, HT_ERROR_INVALID_ARGUMENT);
+  /* Windows of the instance keep it alive until they are destroyed */
+  htReleaseInstance(*instance, 1);
+  *instance = NULL;
   return HT_ERROR_NONE;
 }
 
@@ -487,9 +2765,37 @@ htDestroyGLContext(HTWindow* window) {
   const char* func = "htDestroyGLContext";
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
-  ASSERT(dpy, func, HT_ERROR_WINDOW_SERVER);
-  if (glXGetCurrentContext() == window->gl.context) glXMakeCurrent(dpy, 0, 0);
-  glXDestroyContext(dpy, window->gl.context);
+  ASSERT(GL_DPY(window), func, HT_ERROR_WINDOW_SERVER);
+  /* Frame objects of the present thread are deleted on the window context */
+  htStopPresentThread(window);
+  if (GET_CURRENT_CONTEXT() == window->gl.context) {
+    MAKE_CURRENT(GL_DPY(window), 0, 0);
+  }
+  htDestroySharedGLContexts(window);
+  DESTROY_CONTEXT(GL_DPY(window), window->gl.context);
+  htDestroyGLDrawable(window);
+  window->gl.context  = NULL;
+  window->gl.drawable = 0;
+  return HT_ERROR_NONE;
+}
+
+int
+htDestroyGLPresentThread(HTWindow* window) {
+  const char* func = "htDestroyGLPresentThread";
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  /* Queued frames are presented before the thread exits */
+  htStopPresentThread(window);
+  return HT_ERROR_NONE;
+}
+
+int
+htDestroyFramebuffer(HTWindow* window) {
+  const char* func = "htDestroyFramebuffer";
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  ASSERT(window->fb.count, func, HT_ERROR_INVALID_ARGUMENT);
+  htDestroyFramebufferImage(window);
   return HT_ERROR_NONE;
 }
 
@@ -498,12 +2804,10 @@ htDestroyInputManager(HTWindow* window) {
   const char* func = "htDestroyInputManager";
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
-  ASSERT(xi_dpy, func, HT_ERROR_UNINITIALIZED_INPUT_MANAGER);
-  /* Close display conntect for raw input */
-  XFlush(xi_dpy);
-  XCloseDisplay(xi_dpy);
-  xi_dpy = NULL;
+  ASSERT(window->hid.opcode, func, HT_ERROR_UNINITIALIZED_INPUT_MANAGER);
   window->hid.opcode = 0;
+  /* Raw input stays selected only for the remaining input managers */
+  htSelectEvents(window);
   return HT_ERROR_NONE;
 }
 
@@ -512,9 +2816,60 @@ htSetCurrentGLContext(HTWindow* window) {
   const char* func = "htSetCurrentGLContext";
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
-  ASSERT(dpy, func, HT_ERROR_WINDOW_SERVER);
-  if (window) glXMakeCurrent(dpy, window->win, window->gl.context);
-  else glXMakeCurrent(dpy, 0, 0);
+  ASSERT(GL_DPY(window), func, HT_ERROR_WINDOW_SERVER);
+  /* Bound API is per-thread state, other threads may not have set it */
+  (void) BIND_API();
+  MAKE_CURRENT(GL_DPY(window), window->gl.drawable, window->gl.context);
+  return HT_ERROR_NONE;
+}
+
+int
+htAcquireSharedGLContext(HTWindow* window) {
+  const char* func = "htAcquireSharedGLContext";
+  unsigned i = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  ASSERT(GL_DPY(window), func, HT_ERROR_WINDOW_SERVER);
+  if (!window->pool.count) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_POOL_EMPTY);
+  }
+  pthread_mutex_lock(&window->pool.lock);
+  for (i = 0; i < window->pool.count && window->pool.busy[i]; ++i);
+  if (i < window->pool.count) window->pool.busy[i] = 1;
+  pthread_mutex_unlock(&window->pool.lock);
+  if (i == window->pool.count) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_POOL_EMPTY);
+  }
+  /* Bind the pooled context to the calling thread, whose API may be unset */
+  if (!BIND_API() || !MAKE_CURRENT(
+        GL_DPY(window), window->pool.pbuffer[i], window->pool.context[i])) {
+    pthread_mutex_lock(&window->pool.lock);
+    window->pool.busy[i] = 0;
+    pthread_mutex_unlock(&window->pool.lock);
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_GL_CONTEXT_CREATION);
+  }
+  return HT_ERROR_NONE;
+}
+
+int
+htReleaseSharedGLContext(HTWindow* window) {
+  const char* func = "htReleaseSharedGLContext";
+  const htGLContext context = GET_CURRENT_CONTEXT();
+  unsigned i = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  ASSERT(GL_DPY(window), func, HT_ERROR_WINDOW_SERVER);
+  for (i = 0; i < window->pool.count; ++i) {
+    if (window->pool.context[i] == context) break;
+  }
+  if (!context || i == window->pool.count) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
+  }
+  /* Unbind from the calling thread before handing the context out again */
+  MAKE_CURRENT(GL_DPY(window), 0, 0);
+  pthread_mutex_lock(&window->pool.lock);
+  window->pool.busy[i] = 0;
+  pthread_mutex_unlock(&window->pool.lock);
   return HT_ERROR_NONE;
 }
 
@@ -523,16 +2878,332 @@ htSwapGLBuffers(HTWindow* window) {
   const char* func = "htSwapGLBuffers";
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
-  ASSERT(dpy, func, HT_ERROR_WINDOW_SERVER);
-  glXSwapBuffers(dpy, window->win);
+  ASSERT(GL_DPY(window), func, HT_ERROR_WINDOW_SERVER);
+  if (window->present.context) htQueuePresent(window);
+  else SWAP_BUFFERS(GL_DPY(window), window->gl.drawable);
   return HT_ERROR_NONE;
 }
 
 int
-htSetWindowInteger(HTWindow* window, HTWindowAttribute type, int data) {
-  const char* func = "htSetWindowInteger";
+htSwapGLBuffersWithDamage(
+    HTWindow* window, const HTRect* rect, unsigned count) {
+  const char* func = "htSwapGLBuffersWithDamage";
+  int damage[HT_GL_DAMAGE_SIZE << 2] = {0};
+  unsigned n = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  ASSERT(rect || !count, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(GL_DPY(window), func, HT_ERROR_WINDOW_SERVER);
+  /* Present thread always swaps whole frames */
+  if (!count || window->present.context) return htSwapGLBuffers(window);
+#ifdef HT_USE_EGL
+  if (window->instance->eglSwapBuffersWithDamage) {
+    n = htGetGLDamage(window, rect, count, damage);
+    window->instance->eglSwapBuffersWithDamage(
+      GL_DPY(window), window->gl.drawable, (const EGLint*) damage, n);
+    return HT_ERROR_NONE;
+  }
+#else
+  /* Copies are not synchronized to vblank and would tear, so GLX swaps the
+   * whole buffer unless the user disabled vsync anyway. Copying from the
+   * back buffer keeps it intact for the next frame. */
+  if (window->instance->glXCopySubBufferMESA && window->gl.double_buffer &&
+      window->win && !window->gl.swap_interval) {
+    unsigned i = 0;
+    n = htGetGLDamage(window, rect, count, damage);
+    for (i = 0; i < n; ++i) {
+      window->instance->glXCopySubBufferMESA(
+        DPY(window),
+        window->gl.drawable,
+        damage[(i << 2) + 0],
+        damage[(i << 2) + 1],
+        damage[(i << 2) + 2],
+        damage[(i << 2) + 3]);
+    }
+    return HT_ERROR_NONE;
+  }
+#endif
+  return htSwapGLBuffers(window);
+}
+
+static void
+htRecordDamage(HTWindow* window, const XRectangle* region, unsigned count) {
+  /* Bounding box as left, top, right, bottom, whole image without region */
+  int* const box = window->fb.damage[window->fb.serial % HT_MAX_FRAMEBUFFERS];
+  unsigned i = 0;
+  box[0] = count ? region[0].x : 0;
+  box[1] = count ? region[0].y : 0;
+  box[2] = count ? box[0] + region[0].width  : FB_IMAGE(window)->width;
+  box[3] = count ? box[1] + region[0].height : FB_IMAGE(window)->height;
+  for (i = 1; i < count; ++i) {
+    box[0] = HT_MIN(box[0], region[i].x);
+    box[1] = HT_MIN(box[1], region[i].y);
+    box[2] = HT_MAX(box[2], region[i].x + region[i].width);
+    box[3] = HT_MAX(box[3], region[i].y + region[i].height);
+  }
+}
+
+static int
+htStaleRect(HTWindow* window, int* clip) {
+  /* Pixels presented since the current buffer was last shown, which a flip
+   * to it would otherwise take from an older frame */
+  const unsigned long shown = window->fb.buffer[window->fb.current].shown;
+  const unsigned long age = window->fb.serial - shown;
+  int box[4] = {0};
+  unsigned long i = 0;
+  if (!window->fb.serial || !age) return 0;
+  box[2] = FB_IMAGE(window)->width;
+  box[3] = FB_IMAGE(window)->height;
+  /* Age is unknown for buffers never shown or older than the history */
+  if (shown && age <= HT_MAX_FRAMEBUFFERS) {
+    const int* damage = window->fb.damage[(shown + 1) % HT_MAX_FRAMEBUFFERS];
+    memcpy(box, damage, sizeof (box));
+    for (i = 2; i <= age; ++i) {
+      damage = window->fb.damage[(shown + i) % HT_MAX_FRAMEBUFFERS];
+      box[0] = HT_MIN(box[0], damage[0]);
+      box[1] = HT_MIN(box[1], damage[1]);
+      box[2] = HT_MAX(box[2], damage[2]);
+      box[3] = HT_MAX(box[3], damage[3]);
+    }
+  }
+  clip[0] = box[0];
+  clip[1] = box[1];
+  clip[2] = box[2] - box[0];
+  clip[3] = box[3] - box[1];
+  return clip[2] > 0 && clip[3] > 0;
+}
+
+static void
+htCopyForward(HTWindow* window) {
+  const XImage* const src = window->fb.buffer[window->fb.last].image;
+  XImage* const dst = FB_IMAGE(window);
+  int clip[4] = {0};
+  int y = 0;
+  if (window->fb.last == window->fb.current || !htStaleRect(window, clip)) {
+    return;
+  }
+  for (y = clip[1]; y < clip[1] + clip[3]; ++y) {
+    memcpy(
+      dst->data + y * dst->bytes_per_line + (clip[0] << 2),
+      src->data + y * src->bytes_per_line + (clip[0] << 2),
+      (size_t) clip[2] << 2);
+  }
+}
+
+static void
+htConvertClip(HTWindow* window, XImage* image, const int* clip) {
+  const unsigned bpp = window->fb.format == HT_PIXEL_FORMAT_RGB565 ? 2 : 4;
+  int y = 0;
+  for (y = clip[1]; y < clip[1] + clip[3]; ++y) {
+    window->fb.convert(
+      (unsigned char*) image->data + y * image->bytes_per_line +
+        (clip[0] << 2),
+      window->fb.pixels + y * window->fb.pitch + clip[0] * bpp,
+      clip[2]);
+  }
+}
+
+int
+htAcquireFramebuffer(HTWindow* window) {
+  const char* func = "htAcquireFramebuffer";
+  int result = HT_ERROR_NONE;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  /* Buffers are gone if reallocating them for a new size failed */
+  if (!window->fb.count) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
+  }
+  /* Sizes set by the user apply before the server confirms them */
+  result = htResizeFramebuffer(window, func);
+  if (result) return result;
+  /* Converted pixels are copied on present, so they are always writable */
+  if (window->fb.pixels) return HT_ERROR_NONE;
+  htNextFramebuffer(window);
+  /* Flips show the whole buffer and damage presents trust the rest of it,
+   * so it must hold the last frame either way */
+  htCopyForward(window);
+  return HT_ERROR_NONE;
+}
+
+static unsigned
+htClipRegion(
+    HTWindow* window, const HTRect* rect, unsigned count, XRectangle* region) {
+  XImage* const image = FB_IMAGE(window);
+  int clip[4] = {0};
+  unsigned n = 0;
+  unsigned i = 0;
+  /* Large damage lists are cheaper to track as the whole window */
+  for (i = 0; i < count && count <= HT_GL_DAMAGE_SIZE; ++i) {
+    if (!htClipRect(&rect[i], image->width, image->height, clip)) continue;
+    region[n].x      = (short) clip[0];
+    region[n].y      = (short) clip[1];
+    region[n].width  = (unsigned short) clip[2];
+    region[n].height = (unsigned short) clip[3];
+    ++n;
+  }
+  return n;
+}
+
+static void
+htMarkPresented(HTWindow* window, const XRectangle* region, unsigned count) {
+  /* Damage history lets the next buffer catch up with this frame */
+  ++window->fb.serial;
+  htRecordDamage(window, region, count);
+  window->fb.buffer[window->fb.current].shown = window->fb.serial;
+  window->fb.last = window->fb.current;
+}
+
+static void
+htPresentPixmap(
+    HTWindow* window, const HTRect* rect, unsigned count, unsigned long msc) {
+  XserverRegion update = None;
+  XRectangle region[HT_GL_DAMAGE_SIZE];
+  const unsigned n = htClipRegion(window, rect, count, region);
+  if (n) update = XFixesCreateRegion(DPY(window), region, n);
+  htMarkPresented(window, region, n);
+  XPresentPixmap(
+    DPY(window),
+    window->win,
+    window->fb.buffer[window->fb.current].pixmap,
+    (unsigned) window->fb.serial,
+    None,
+    update,
+    0,
+    0,
+    None,
+    None,
+    None,
+    PresentOptionNone,
+    msc,
+    0,
+    0,
+    NULL,
+    0);
+  if (update) XFixesDestroyRegion(DPY(window), update);
+  /* Server reports with PresentIdleNotify once it stopped reading */
+  LOCK();
+  window->fb.buffer[window->fb.current].busy = 1;
+  UNLOCK();
+}
+
+static int
+htPresentRects(
+    HTWindow* window, const HTRect* rect, unsigned count, unsigned long msc) {
+  HTRect full = {0};
+  XImage* image = NULL;
+  XRectangle region[HT_GL_DAMAGE_SIZE];
+  int clip[4] = {0};
+  unsigned last = 0;
+  unsigned i = 0;
+  if (!count) {
+    full.width  = FB_IMAGE(window)->width;
+    full.height = FB_IMAGE(window)->height;
+    rect  = &full;
+    count = 1;
+  }
+  if (window->fb.convert) {
+    /* Only damaged pixels are converted, the rest is never pushed */
+    htNextFramebuffer(window);
+    image = FB_IMAGE(window);
+    for (i = 0; i < count; ++i) {
+      if (htClipRect(&rect[i], image->width, image->height, clip)) {
+        htConvertClip(window, image, clip);
+      }
+    }
+    /* Flips show the whole buffer, so it must hold the last frame */
+    if (window->fb.eid && htStaleRect(window, clip)) {
+      htConvertClip(window, image, clip);
+    }
+  }
+  if (window->fb.eid) {
+    htPresentPixmap(window, rect, count, msc);
+    htFlush(window->instance, HT_FLUSH_ON_SWAP);
+    return HT_ERROR_NONE;
+  }
+  image = FB_IMAGE(window);
+  /* Request a single ShmCompletion, sent after the last rectangle */
+  for (i = 0, last = count; i < count; ++i) {
+    if (htClipRect(&rect[i], image->width, image->height, clip)) last = i;
+  }
+  for (i = 0; i < count && last < count; ++i) {
+    if (!htClipRect(&rect[i], image->width, image->height, clip)) continue;
+    if (window->fb.buffer[window->fb.current].shm.shmaddr) {
+      XShmPutImage(
+        DPY(window),
+        window->win,
+        window->fb.gc,
+        image,
+        clip[0],
+        clip[1],
+        clip[0],
+        clip[1],
+        clip[2],
+        clip[3],
+        i == last);
+    } else {
+      XPutImage(
+        DPY(window),
+        window->win,
+        window->fb.gc,
+        image,
+        clip[0],
+        clip[1],
+        clip[0],
+        clip[1],
+        clip[2],
+        clip[3]);
+    }
+  }
+  if (last < count) {
+    htMarkPresented(window, region, htClipRegion(window, rect, count, region));
+  }
+  /* Server reports with ShmCompletion once it stopped reading */
+  if (last < count && window->fb.buffer[window->fb.current].shm.shmaddr) {
+    window->fb.buffer[window->fb.current].busy = 1;
+  }
+  htFlush(window->instance, HT_FLUSH_ON_SWAP);
+  return HT_ERROR_NONE;
+}
+
+int
+htPresentFramebuffer(HTWindow* window) {
+  return htPresentFramebufferWithDamage(window, NULL, 0);
+}
+
+int
+htPresentFramebufferWithDamage(
+    HTWindow* window, const HTRect* rect, unsigned count) {
+  const char* func = "htPresentFramebufferWithDamage";
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  /* Buffers are gone if reallocating them for a new size failed */
+  if (!window->fb.count) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
+  }
+  ASSERT(rect || !count, func, HT_ERROR_INVALID_ARGUMENT);
+  return htPresentRects(window, rect, count, 0);
+}
+
+int
+htPresentFramebufferAtMSC(HTWindow* window, unsigned long msc) {
+  const char* func = "htPresentFramebufferAtMSC";
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  /* Buffers are gone if reallocating them for a new size failed */
+  if (!window->fb.count) {
+    return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
+  }
+  /* Without the Present extension the frame is shown immediately */
+  return htPresentRects(window, NULL, 0, msc);
+}
+
+static int
+htSetInteger(
+    HTWindow* window,
+    const char* func,
+    HTWindowAttribute type,
+    int data,
+    unsigned* configure) {
   switch (type) {
     case HT_GL_ACCELERATED:
       window->gl.accelerated = data != 0;
@@ -594,32 +3265,103 @@ htSetWindowInteger(HTWindow* window, HTWindowAttribute type, int data) {
     case HT_GL_SWAP_INTERVAL:
       window->gl.swap_interval = data != 0;
       break;
+    case HT_INPUT_MOUSE_GRAB:
+      /* Offscreen windows have no pointer to capture */
+      if (!window->win) {
+        return INSTANCE_ERROR(
+          window->instance, func, HT_ERROR_INVALID_ARGUMENT);
+      }
+      window->hid.grab = data != 0;
+      htSelectEvents(window);
+      if (!window->hid.grab) {
+        htUngrabPointer(window);
+      } else if (window->info.focus && !htGrabPointer(window)) {
+        return INSTANCE_ERROR(window->instance, func, HT_ERROR_WINDOW_SERVER);
+      }
+      break;
     case HT_WINDOW_HEIGHT:
-      window->info.height = data & 0x3FFF;
-      MOVE_RESIZE_WINDOW(dpy, window);
+      window->info.height = HT_CLAMP_SIZE(data);
+      *configure |= CWHeight;
+      break;
+    case HT_WINDOW_PIXEL_FORMAT:
+      /* Layout is fixed while a framebuffer exists */
+      if (window->fb.count || data < 0 || data > HT_PIXEL_FORMAT_RGB565) {
+        return INSTANCE_ERROR(
+          window->instance, func, HT_ERROR_INVALID_ARGUMENT);
+      }
+      window->fb.format = data;
+      break;
+    case HT_WINDOW_FULLSCREEN:
+      window->info.fullscreen = data != 0;
+      if (window->win && !htStageAttribute(window, HT_STAGE_FULLSCREEN, NULL)) {
+        htSetFullscreen(window);
+      }
+      break;
+    case HT_WINDOW_FRAMEBUFFERS:
+      /* Ring size is fixed while a framebuffer exists */
+      if (window->fb.count || data < 1) {
+        return INSTANCE_ERROR(
+          window->instance, func, HT_ERROR_INVALID_ARGUMENT);
+      }
+      window->fb.buffers = HT_MIN(data, HT_MAX_FRAMEBUFFERS);
       break;
     case HT_WINDOW_STYLE:
       /* TODO: Window decorations managed by window manager, not X11 */
       window->info.style = HT_WINDOW_STYLE_DEFAULT;
       break;
     case HT_WINDOW_WIDTH:
-      window->info.width = data & 0x3FFF;
-      MOVE_RESIZE_WINDOW(dpy, window);
+      window->info.width = HT_CLAMP_SIZE(data);
+      *configure |= CWWidth;
       break;
     case HT_WINDOW_X:
-      window->info.x = data;
-      MOVE_RESIZE_WINDOW(dpy, window);
+      /* Coordinates are INT16 on the wire, larger ones would wrap */
+      window->info.x = HT_CLAMP_POSITION(data);
+      *configure |= CWX;
       break;
     case HT_WINDOW_Y:
-      window->info.y = data;
-      MOVE_RESIZE_WINDOW(dpy, window);
+      window->info.y = HT_CLAMP_POSITION(data);
+      *configure |= CWY;
       break;
     default:
-      return HANDLE_ERROR(func, HT_ERROR_INVALID_ARGUMENT);
+      return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
   }
   return HT_ERROR_NONE;
 }
 
+int
+htSetWindowInteger(HTWindow* window, HTWindowAttribute type, int data) {
+  const char* func = "htSetWindowInteger";
+  unsigned configure = 0;
+  int error = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  error = htSetInteger(window, func, type, data, &configure);
+  if (!error) error = htConfigureWindow(window, configure);
+  return error;
+}
+
+int
+htSetWindowIntegers(
+    HTWindow* window,
+    const HTWindowAttribute* type,
+    const int* data,
+    unsigned count) {
+  const char* func = "htSetWindowIntegers";
+  unsigned configure = 0;
+  unsigned i = 0;
+  int error = 0;
+  ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
+  ASSERT((type && data) || !count, func, HT_ERROR_INVALID_ARGUMENT);
+  for (i = 0; i < count && !error; ++i) {
+    error = htSetInteger(window, func, type[i], data[i], &configure);
+  }
+  /* Geometry applied before a failing attribute is still sent */
+  if (!error) error = htConfigureWindow(window, configure);
+  else htConfigureWindow(window, configure);
+  return error;
+}
+
 int
 htSetWindowUntyped(
     HTWindow* window, HTWindowAttribute type, unsigned char* data) {
@@ -627,9 +3369,15 @@ htSetWindowUntyped(
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
   switch (type) {
-    case HT_WINDOW_TITLE: XStoreName(dpy, window->win, (char*) data); break;
-    case HT_WINDOW_USER:  window->user = data;                        break;
-    default: return HANDLE_ERROR(func, HT_ERROR_INVALID_ARGUMENT);
+    case HT_WINDOW_TITLE:
+      if (window->win && !(data &&
+          htStageAttribute(window, HT_STAGE_TITLE, (const char*) data))) {
+        XStoreName(DPY(window), window->win, (char*) data);
+      }
+      break;
+    case HT_WINDOW_USER: window->user = data; break;
+    default:
+      return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
   }
   return HT_ERROR_NONE;
 }
@@ -649,6 +3397,7 @@ htGetWindowInteger(HTWindow* window, HTWindowAttribute type, int* data) {
     case HT_GL_COLOR_BUFFER:      *data = window->gl.color;          break;
     case HT_GL_DEPTH_BUFFER:      *data = window->gl.depth;          break;
     case HT_GL_DOUBLE_BUFFERING:  *data = window->gl.double_buffer;  break;
+    case HT_GL_FOOTPRINT:         *data = htGetGLMemory(window);     break;
     case HT_GL_GREEN:             *data = window->gl.green;          break;
     case HT_GL_MAJOR_VERSION:     *data = window->gl.major;          break;
     case HT_GL_MINOR_VERSION:     *data = window->gl.minor;          break;
@@ -661,15 +3410,31 @@ htGetWindowInteger(HTWindow* window, HTWindowAttribute type, int* data) {
     case HT_GL_STEREO:            *data = window->gl.stereo;         break;
     case HT_GL_SWAP_INTERVAL:     *data = window->gl.swap_interval;  break;
     case HT_INPUT_MOUSE_BUTTON:   *data = HEAD_MOUSE_BUTTON(window); break;
+    case HT_INPUT_MOUSE_GRAB:     *data = window->hid.grab;          break;
     case HT_INPUT_MOUSE_RELATIVE: *data = htIsRelative(window);     break;
     case HT_INPUT_MOUSE_X:        *data = HEAD_MOUSE_X(window);      break;
     case HT_INPUT_MOUSE_Y:        *data = HEAD_MOUSE_Y(window);      break;
     case HT_WINDOW_HEIGHT:        *data = window->info.height;       break;
+    case HT_WINDOW_MONITOR:
+      *data = htGetWindowMonitor(window);
+      break;
+    case HT_WINDOW_PITCH:
+      *data = window->fb.pixels ? (int) window->fb.pitch :
+        window->fb.count ? FB_IMAGE(window)->bytes_per_line : 0;
+      break;
+    case HT_WINDOW_FRAMEBUFFERS:  *data = window->fb.buffers;        break;
+    case HT_WINDOW_FULLSCREEN:    *data = window->info.fullscreen;   break;
+    case HT_WINDOW_PIXEL_FORMAT:  *data = window->fb.format;         break;
+    case HT_WINDOW_REFRESH_RATE:
+      *data = htGetWindowRefreshRate(window);
+      break;
     case HT_WINDOW_STYLE:         *data = window->info.style;        break;
+    case HT_WINDOW_UNREDIRECTED:  *data = htIsUnredirected(window);  break;
     case HT_WINDOW_WIDTH:         *data = window->info.width;        break;
     case HT_WINDOW_X:             *data = window->info.x;            break;
     case HT_WINDOW_Y:             *data = window->info.y;            break;
-    default: return HANDLE_ERROR(func, HT_ERROR_INVALID_ARGUMENT);
+    default:
+      return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
   }
   return HT_ERROR_NONE;
 }
@@ -682,8 +3447,16 @@ htGetWindowUntyped(
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
   ASSERT(data, func, HT_ERROR_INVALID_ARGUMENT);
   switch (type) {
+    case HT_WINDOW_FRAMEBUFFER:
+      *data = window->fb.pixels ? window->fb.pixels :
+        window->fb.count ? (unsigned char*) FB_IMAGE(window)->data : 0;
+      break;
+    case HT_WINDOW_PRESENT_INFO:
+      *data = (unsigned char*) &window->fb.info;
+      break;
     case HT_WINDOW_USER: *data = window->user; break;
-    default: return HANDLE_ERROR(func, HT_ERROR_INVALID_ARGUMENT);
+    default:
+      return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
   }
   return HT_ERROR_NONE;
 }
@@ -703,42 +3476,255 @@ htSetEventHandler(HTWindow* window, HTEvent type, HTEventHandler callback) {
     case HT_EVENT_KEYBOARD: window->event.keyboard = callback; break;
     case HT_EVENT_MOUSE:    window->event.mouse    = callback; break;
     case HT_EVENT_GAMEPAD:  window->event.gamepad  = callback; break;
-    default: return HANDLE_ERROR(func, HT_ERROR_INVALID_ARGUMENT);
+    case HT_EVENT_PRESENT:  window->event.present  = callback; break;
+    default:
+      return INSTANCE_ERROR(window->instance, func, HT_ERROR_INVALID_ARGUMENT);
   }
+  /* Server only generates the events some handler consumes */
+  htSelectEvents(window);
   return HT_ERROR_NONE;
 }
 
 int
 htSetWindowErrorCallback(HTWindowErrorCallback callback) {
+  LOCK();
   ht_error_handler = callback;
+  UNLOCK();
+  return HT_ERROR_NONE;
+}
+
+int
+htSetInstanceErrorCallback(
+    HTInstance* instance, HTWindowErrorCallback callback) {
+  const char* func = "htSetInstanceErrorCallback";
+  ASSERT(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  LOCK();
+  instance->error = callback;
+  UNLOCK();
+  return HT_ERROR_NONE;
+}
+
+int
+htSetFlushPolicy(HTInstance* instance, HTFlushPolicy policy) {
+  const char* func = "htSetFlushPolicy";
+  ASSERT(policy <= HT_FLUSH_ON_POLL, func, HT_ERROR_INVALID_ARGUMENT);
+  LOCK();
+  if (!instance) instance = ht_instance;
+  if (instance) instance->flush = policy;
+  UNLOCK();
+  /* Default instance only exists while a window or user holds it */
+  if (!instance) return HANDLE_ERROR(func, HT_ERROR_INVALID_ARGUMENT);
+  return HT_ERROR_NONE;
+}
+
+int
+htGetMonitors(HTInstance* instance, HTMonitor* monitor, unsigned* count) {
+  const char* func = "htGetMonitors";
+  unsigned i = 0;
+  ASSERT(count, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(monitor || !*count, func, HT_ERROR_INVALID_ARGUMENT);
+  LOCK();
+  if (!instance) instance = ht_instance;
+  /* Default instance must outlive the round trips made without the lock */
+  if (instance) ++instance->refs;
+  UNLOCK();
+  if (!instance) return HANDLE_ERROR(func, HT_ERROR_INVALID_ARGUMENT);
+  if (instance->dpy) htValidateMonitors(instance);
+  LOCK();
+  /* At most count monitors are copied, count returns how many exist */
+  for (i = 0; i < *count && i < instance->monitors; ++i) {
+    monitor[i] = instance->monitor[i];
+  }
+  *count = instance->monitors;
+  UNLOCK();
+  htReleaseInstance(instance, 1);
+  return HT_ERROR_NONE;
+}
+
+int
+htGetEventFds(HTInstance* instance, int* fd, unsigned* count) {
+  const char* func = "htGetEventFds";
+  ASSERT(count, func, HT_ERROR_INVALID_ARGUMENT);
+  ASSERT(fd || !*count, func, HT_ERROR_INVALID_ARGUMENT);
+  LOCK();
+  if (!instance) instance = ht_instance;
+  /* Windows and raw input share one connection, so there is one socket */
+  if (instance && instance->dpy && *count) {
+    fd[0] = ConnectionNumber(instance->dpy);
+  }
+  if (instance) *count = instance->dpy ? 1 : 0;
+  UNLOCK();
+  if (!instance) return HANDLE_ERROR(func, HT_ERROR_INVALID_ARGUMENT);
+  return HT_ERROR_NONE;
+}
+
+int
+htDispatchReady(HTInstance* instance) {
+  const char* func = "htDispatchReady";
+  htWindowList list = {0};
+  HTWindow* window = NULL;
+  XEvent event = {0};
+  unsigned count = 0;
+  unsigned i = 0;
+  int snapshot = 0;
+  int orphans = 0;
+  LOCK();
+  if (!instance) instance = ht_instance;
+  /* Handlers may destroy every window, which must not close the display */
+  if (instance && instance->dpy) {
+    ++instance->refs;
+    snapshot = htSnapshotWindows(instance, &count);
+  }
+  UNLOCK();
+  if (!instance || !instance->dpy) {
+    return INSTANCE_ERROR(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  }
+  if (!snapshot) {
+    INSTANCE_ERROR(instance, func, HT_ERROR_MEMORY_ALLOCATION);
+    htReleaseInstance(instance, 1);
+    return HT_ERROR_MEMORY_ALLOCATION;
+  }
+  /* Move whatever arrived into the queue without blocking */
+  XEventsQueued(instance->dpy, QueuedAfterReading);
+  htPollMonitorEvents(instance);
+  htPollSelectionEvents(instance);
+  for (i = 0; i < count; ++i) {
+    window = instance->snapshot[i];
+    /* Handlers may destroy any window, offscreen ones receive no events */
+    if (!htIsRegistered(instance, window) || !window->win) continue;
+    htPollWindowEvents(window);
+    htPollInputEvents(window);
+  }
+  /* Unclaimed events would keep the queue from ever running empty */
+  LOCK();
+  orphans = htSnapshotWindows(instance, &list.count);
+  list.instance = instance;
+  list.win = instance->snapshot_win;
+  list.fb = instance->snapshot_fb;
+  UNLOCK();
+  while (orphans && XCheckIfEvent(
+      instance->dpy, &event, htIsOrphanEvent, (XPointer) &list)) {
+    continue;
+  }
+  /* Requests sent by handlers must not wait for the next wake-up */
+  XFlush(instance->dpy);
+  htReleaseInstance(instance, 1);
+  return HT_ERROR_NONE;
+}
+
+int
+htBeginUpdate(HTInstance* instance) {
+  const char* func = "htBeginUpdate";
+  LOCK();
+  if (!instance) instance = ht_instance;
+  if (instance) ++instance->update;
+  UNLOCK();
+  if (!instance) return HANDLE_ERROR(func, HT_ERROR_INVALID_ARGUMENT);
+  return HT_ERROR_NONE;
+}
+
+int
+htCommitUpdate(HTInstance* instance) {
+  const char* func = "htCommitUpdate";
+  HTWindow* window = NULL;
+  unsigned configure = 0;
+  LOCK();
+  if (!instance) instance = ht_instance;
+  if (!instance || !instance->update) {
+    UNLOCK();
+    return INSTANCE_ERROR(instance, func, HT_ERROR_INVALID_ARGUMENT);
+  }
+  /* Nested updates are sent with the outermost one */
+  if (--instance->update) {
+    UNLOCK();
+    return HT_ERROR_NONE;
+  }
+  for (window = instance->windows; window; window = window->next) {
+    configure = window->configure;
+    window->configure = 0;
+    htConfigureWindow(window, configure);
+    if (window->staged & HT_STAGE_TITLE) {
+      XStoreName(DPY(window), window->win, window->title);
+      free(window->title);
+      window->title = NULL;
+    }
+    if (window->staged & HT_STAGE_FULLSCREEN) htSetFullscreen(window);
+    window->staged = 0;
+  }
+  /* Staged requests of all windows go out in a single write */
+  if (instance->dpy) XFlush(instance->dpy);
+  UNLOCK();
   return HT_ERROR_NONE;
 }
 
 int
 htPollWindowEvents(HTWindow* window) {
   const char* func = "htPollWindowEvents";
+  HTWindow* owner = NULL;
   XEvent event = {0};
+  unsigned done = 0;
   ASSERT(window, func, HT_ERROR_INVALID_ARGUMENT);
   ASSERT(VALID_WINDOW(window), func, HT_ERROR_UNINITIALIZED_WINDOW);
-  ASSERT(dpy, func, HT_ERROR_WINDOW_SERVER);
-  if (window->info.focus) htPollRawInput(window);
-  while (XCheckWindowEvent(dpy, window->win, HT_EVENT_MASK, &event)) {
+  /* Surfaceless offscreen windows have no connection to read events from */
+  if (!DPY(window)) return HT_ERROR_NONE;
+  if (window->hid.opcode) {
+    owner = htGetInputOwner(window->instance);
+    if (owner == window) htPollRawInput(window);
+    else if (!owner) htDiscardRawInput(window, 0);
+  }
+  while (XCheckWindowEvent(DPY(window), window->win, HT_EVENT_MASK, &event)) {
     switch (event.type) {
       case ConfigureNotify:
         htConfigureNotify(window, &event);
         break;
+      case PropertyNotify:
+        if (event.xproperty.atom == window->instance->wm_state) {
+          htPropertyNotify(window);
+        }
+        break;
+      case Expose:
+        /* Only the last of a series of exposures asks for a redraw */
+        if (!event.xexpose.count) HT_HANDLE_EVENT(window, window->event.draw);
+        break;
       case FocusIn:
       case FocusOut:
         window->info.focus = event.type == FocusIn;
+        htSelectEvents(window);
+        /* Input that arrived while unfocused is stale by now */
+        if (window->info.focus && window->hid.opcode) {
+          htDiscardRawInput(window, 0);
+        }
+        /* Captured pointer is handed back whenever focus moves away */
+        if (window->hid.grab && window->info.focus) htGrabPointer(window);
+        else htUngrabPointer(window);
         HT_HANDLE_EVENT(window, window->event.focus);
         break;
       default: break;
     }
   }
+  /* Framebuffers the server finished reading can be acquired again, those
+   * of a destroyed framebuffer are only dequeued */
+  while (window->instance->shm_completion &&
+      XCheckTypedWindowEvent(
+        DPY(window), window->win, window->instance->shm_completion, &event)) {
+    htShmCompletion(window, &event);
+  }
+  /* Monitor and compositor caches are shared, so any window may update them */
+  htPollMonitorEvents(window->instance);
+  htPollSelectionEvents(window->instance);
+  /* Present events are routed to their window by htPresentNotify */
+  while (XCheckIfEvent(
+      DPY(window), &event, htIsPresentEvent, (XPointer) window->instance)) {
+    htPresentNotify(window->instance, &event);
+  }
+  LOCK();
+  done = window->fb.done;
+  window->fb.done = 0;
+  UNLOCK();
+  if (done) HT_HANDLE_EVENT(window, window->event.present);
   /* XCheckWindowEvent does not dequeue ClientMessage events */
-  if (XCheckTypedWindowEvent(dpy, window->win, ClientMessage, &event) &&
-      *event.xclient.data.l ==
-      (long) XInternAtom(dpy, "WM_DELETE_WINDOW", True) &&
+  if (XCheckTypedWindowEvent(DPY(window), window->win, ClientMessage, &event) &&
+      *event.xclient.data.l == (long) window->instance->wm_delete_window &&
       window->event.close) {
     window->event.close(window);
   }
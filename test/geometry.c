@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#ifndef __APPLE__
+#include <X11/Xlib.h>
+#endif
+#include "window.h"
+
+/* Round-trips window geometry through htSetWindowInteger and
+ * htGetWindowInteger, including sizes beyond 8191 and negative positions.
+ * On X11 the geometry the server applied is read back over a second
+ * connection, which assumes no window manager reparents the window.
+ * Windows that cannot be created, e.g. without a display, are skipped. */
+
+#define CHECK_TITLE   "geometry check"
+#define CHECK_ATTEMPTS 1000
+
+#ifndef __APPLE__
+static Display* server = NULL;
+static Window server_win = None;
+
+static Window
+findWindow(Display* dpy) {
+  Window root = None;
+  Window parent = None;
+  Window* child = NULL;
+  Window found = None;
+  unsigned count = 0;
+  unsigned i = 0;
+  char* name = NULL;
+  if (!XQueryTree(
+        dpy, DefaultRootWindow(dpy), &root, &parent, &child, &count)) {
+    return None;
+  }
+  for (i = 0; i < count && !found; ++i) {
+    if (XFetchName(dpy, child[i], &name) && name) {
+      if (!strcmp(name, CHECK_TITLE)) found = child[i];
+      XFree(name);
+    }
+  }
+  if (child) XFree(child);
+  return found;
+}
+
+static int
+checkServer(HTWindow* window, HTWindowAttribute type, int want) {
+  Window root = None;
+  int x = 0;
+  int y = 0;
+  unsigned width = 0;
+  unsigned height = 0;
+  unsigned border = 0;
+  unsigned depth = 0;
+  int got = 0;
+  unsigned i = 0;
+  if (!server_win) return 0;
+  /* Polling flushes the request, the server applies it in its own time */
+  for (i = 0; i < CHECK_ATTEMPTS; ++i) {
+    htPollWindowEvents(window);
+    XSync(server, False);
+    XGetGeometry(
+      server, server_win, &root, &x, &y, &width, &height, &border, &depth);
+    switch (type) {
+      case HT_WINDOW_WIDTH:  got = (int) width;  break;
+      case HT_WINDOW_HEIGHT: got = (int) height; break;
+      case HT_WINDOW_X:      got = x;            break;
+      default:               got = y;            break;
+    }
+    if (got == want) return 0;
+  }
+  fprintf(
+    stderr,
+    "attribute %d: server has %d, expected %d\n",
+    (int) type,
+    got,
+    want);
+  return 1;
+}
+#endif
+
+static int
+checkInteger(HTWindow* window, HTWindowAttribute type, int set, int want) {
+  int got = 0;
+  if (htSetWindowInteger(window, type, set) ||
+      htGetWindowInteger(window, type, &got) ||
+      got != want) {
+    fprintf(
+      stderr,
+      "attribute %d: set %d, got %d, expected %d\n",
+      (int) type,
+      set,
+      got,
+      want);
+    return 1;
+  }
+#ifndef __APPLE__
+  return checkServer(window, type, want);
+#else
+  return 0;
+#endif
+}
+
+static int
+checkGeometry(HTWindow* window) {
+  int failed = 0;
+  failed += checkInteger(window, HT_WINDOW_WIDTH,   8192,   8192);
+  failed += checkInteger(window, HT_WINDOW_HEIGHT,  12000,  12000);
+  failed += checkInteger(window, HT_WINDOW_WIDTH,   65535,  65535);
+  failed += checkInteger(window, HT_WINDOW_WIDTH,   70000,  65535);
+  failed += checkInteger(window, HT_WINDOW_WIDTH,   0,      1);
+  failed += checkInteger(window, HT_WINDOW_HEIGHT,  -5,     1);
+  failed += checkInteger(window, HT_WINDOW_X,       -100,   -100);
+  failed += checkInteger(window, HT_WINDOW_Y,       -32768, -32768);
+  failed += checkInteger(window, HT_WINDOW_X,       -40000, -32768);
+  failed += checkInteger(window, HT_WINDOW_Y,       40000,  32767);
+  return failed;
+}
+
+int
+main(void) {
+  HTWindow* window = NULL;
+  unsigned checked = 0;
+#ifndef __APPLE__
+  unsigned i = 0;
+#endif
+  int failed = 0;
+  if (!htCreateOffscreenWindow(&window, NULL, 64, 64)) {
+    failed += checkGeometry(window);
+    htDestroyWindow(&window);
+    ++checked;
+  }
+  if (!htCreateWindow(&window, 0, 0, 64, 64)) {
+#ifndef __APPLE__
+    htSetWindowUntyped(window, HT_WINDOW_TITLE, (unsigned char*) CHECK_TITLE);
+    server = XOpenDisplay(NULL);
+    /* Title must reach the server before the window can be found by it */
+    for (i = 0; server && !server_win && i < CHECK_ATTEMPTS; ++i) {
+      htPollWindowEvents(window);
+      XSync(server, False);
+      server_win = findWindow(server);
+    }
+    if (!server_win) printf("geometry: server check skipped\n");
+#endif
+    failed += checkGeometry(window);
+    htDestroyWindow(&window);
+#ifndef __APPLE__
+    if (server) XCloseDisplay(server);
+    server_win = None;
+#endif
+    ++checked;
+  }
+  if (!checked) printf("geometry: skipped, no window could be created\n");
+  else printf("geometry: %d failed\n", failed);
+  return failed != 0;
+}